@@ -1,107 +1,98 @@
 #pragma once
 
-#include <any>
-#include <memory>
+#include <cstdint>
 #include <utility>  // std::move
 #include <vector>
 #include "../scanner/token.h"
 #include "../scanner/Expr.h"
 
-struct Block;
-struct Expression;
-struct If;
-struct Print;
-struct Var;
-struct While;
-
-struct StmtVisitor {
-virtual std::any visitBlockStmt(std::shared_ptr<Block> stmt) = 0;
-virtual std::any visitExpressionStmt(std::shared_ptr<Expression> stmt) = 0;
-virtual std::any visitIfStmt(std::shared_ptr<If> stmt) = 0;
-virtual std::any visitPrintStmt(std::shared_ptr<Print> stmt) = 0;
-virtual std::any visitVarStmt(std::shared_ptr<Var> stmt) = 0;
-virtual std::any visitWhileStmt(std::shared_ptr<While> stmt) = 0;
-virtual ~StmtVisitor() = default;
+enum class StmtKind : std::uint8_t {
+  Block,
+  Expression,
+  If,
+  Print,
+  Var,
+  While,
 };
 
 struct Stmt
 {
- virtual std::any accept(StmtVisitor& visitor) = 0;
+  const StmtKind kind;
+
+protected:
+  explicit Stmt(StmtKind kind) : kind(kind) {}
 };
 
-struct Block: Stmt, public std::enable_shared_from_this<Block> {
-  Block(std::vector<std::shared_ptr<Stmt>> statements)
-  : statements{std::move(statements)}
+struct Block: Stmt {
+  Block(std::vector<const Stmt*> statements)
+  : Stmt{StmtKind::Block}, statements{std::move(statements)}
   {}
 
-  std::any accept(StmtVisitor& visitor) override {
-    return visitor.visitBlockStmt(shared_from_this());
-  }
-
-  const std::vector<std::shared_ptr<Stmt>> statements;
+  const std::vector<const Stmt*> statements;
 };
 
-struct Expression: Stmt, public std::enable_shared_from_this<Expression> {
-  Expression(std::shared_ptr<Expr> expression)
-  : expression{std::move(expression)}
+struct Expression: Stmt {
+  Expression(const Expr* expression)
+  : Stmt{StmtKind::Expression}, expression{std::move(expression)}
   {}
 
-  std::any accept(StmtVisitor& visitor) override {
-    return visitor.visitExpressionStmt(shared_from_this());
-  }
-
-  const std::shared_ptr<Expr> expression;
+  const Expr* const expression;
 };
 
-struct If: Stmt, public std::enable_shared_from_this<If> {
-  If(std::shared_ptr<Expr> condition, std::shared_ptr<Stmt> thenBranch, std::shared_ptr<Stmt> elseBranch)
-  : condition{std::move(condition)}, thenBranch{std::move(thenBranch)}, elseBranch{std::move(elseBranch)}
+struct If: Stmt {
+  If(const Expr* condition, const Stmt* thenBranch, const Stmt* elseBranch)
+  : Stmt{StmtKind::If}, condition{std::move(condition)}, thenBranch{std::move(thenBranch)}, elseBranch{std::move(elseBranch)}
   {}
 
-  std::any accept(StmtVisitor& visitor) override {
-    return visitor.visitIfStmt(shared_from_this());
-  }
-
-  const std::shared_ptr<Expr> condition;
-  const std::shared_ptr<Stmt> thenBranch;
-  const std::shared_ptr<Stmt> elseBranch;
+  const Expr* const condition;
+  const Stmt* const thenBranch;
+  const Stmt* const elseBranch;
 };
 
-struct Print: Stmt, public std::enable_shared_from_this<Print> {
-  Print(std::shared_ptr<Expr> expression)
-  : expression{std::move(expression)}
+struct Print: Stmt {
+  Print(const Expr* expression)
+  : Stmt{StmtKind::Print}, expression{std::move(expression)}
   {}
 
-  std::any accept(StmtVisitor& visitor) override {
-    return visitor.visitPrintStmt(shared_from_this());
-  }
-
-  const std::shared_ptr<Expr> expression;
+  const Expr* const expression;
 };
 
-struct Var: Stmt, public std::enable_shared_from_this<Var> {
-  Var(Token name, std::shared_ptr<Expr> initializer)
-  : name{std::move(name)}, initializer{std::move(initializer)}
+struct Var: Stmt {
+  Var(Token name, const Expr* initializer)
+  : Stmt{StmtKind::Var}, name{std::move(name)}, initializer{std::move(initializer)}
   {}
 
-  std::any accept(StmtVisitor& visitor) override {
-    return visitor.visitVarStmt(shared_from_this());
-  }
-
   const Token name;
-  const std::shared_ptr<Expr> initializer;
+  const Expr* const initializer;
 };
 
-struct While: Stmt, public std::enable_shared_from_this<While> {
-  While(std::shared_ptr<Expr> condition, std::shared_ptr<Stmt> body)
-  : condition{std::move(condition)}, body{std::move(body)}
+struct While: Stmt {
+  While(const Expr* condition, const Stmt* body)
+  : Stmt{StmtKind::While}, condition{std::move(condition)}, body{std::move(body)}
   {}
 
-  std::any accept(StmtVisitor& visitor) override {
-    return visitor.visitWhileStmt(shared_from_this());
-  }
-
-  const std::shared_ptr<Expr> condition;
-  const std::shared_ptr<Stmt> body;
+  const Expr* const condition;
+  const Stmt* const body;
 };
 
+template <class Derived, class R>
+struct StmtVisitor {
+  R visit(const Stmt* stmt) {
+    Derived& self = static_cast<Derived&>(*this);
+    switch (stmt->kind) {
+      case StmtKind::Block:
+        return self.visitBlockStmt(static_cast<const Block*>(stmt));
+      case StmtKind::Expression:
+        return self.visitExpressionStmt(static_cast<const Expression*>(stmt));
+      case StmtKind::If:
+        return self.visitIfStmt(static_cast<const If*>(stmt));
+      case StmtKind::Print:
+        return self.visitPrintStmt(static_cast<const Print*>(stmt));
+      case StmtKind::Var:
+        return self.visitVarStmt(static_cast<const Var*>(stmt));
+      default:
+      case StmtKind::While:
+        return self.visitWhileStmt(static_cast<const While*>(stmt));
+    }
+  }
+};
@@ -0,0 +1,431 @@
+#pragma once
+
+#include<cstdint>
+#include<cstdio>
+#include<cstring>
+#include<string>
+#include<string_view>
+#include<type_traits>
+#include<unordered_map>
+#include<variant>
+#include<vector>
+#include<fcntl.h>
+#include<unistd.h>
+#include"../utils/interner.h"
+#include"../utils/sourceBuffer.h"
+#include"../utils/value.h"
+#include"flatAst.h"
+
+/*
+On-disk cache of a compiled script (.loxc), so that running an unchanged script skips scanning, parsing and flattening.
+
+The file is the FlatAst written out as tables, in the order they are read back :
+    - header  : magic, format version, size and 64 bit FNV-1a hash of the source it was compiled from, the
+                options it was compiled with, table sizes, number of global slots
+    - nodes   : the FlatNodes, in post-order (20 bytes each)
+    - lists   : block bodies and the program, as indices into nodes
+    - locations, constants : fixed size records pointing into the table of texts
+    - texts   : every distinct lexeme and string constant, flagged when it is a name (names are
+                interned once each on load, not once per use)
+    - bytes   : the characters of those texts
+
+Loading maps the file, checks the header against the current source and copies the fixed size tables out.
+Every index in them is checked before the program is handed out (see consistent()) : a damaged file whose
+size and hash still match is rejected, never followed out of bounds.
+Lexemes keep viewing the mapping, which the cache owns, so the AstCache must outlive the program it loaded.
+A cache made from other source text, with other options (or by another format version) is simply not used :
+the caller compiles again and overwrites it. Files are written to a temporary name and renamed, so a reader never sees half of one.
+*/
+class AstCache{
+
+public:
+    static constexpr std::uint32_t version = 5;
+
+    // What a program is compiled with besides its source. They change the result : a script that parsed
+    // under a high --max-depth is "Nesting is too deep." under the default one, and --no-optimize asks
+    // for the tree as written, not the one the optimizer made of it
+    struct Options {
+        std::int32_t maxDepth;
+        std::uint32_t optimized;  // 0 or 1
+
+        bool operator==(const Options& other) const {
+            return maxDepth == other.maxDepth && optimized == other.optimized;
+        }
+    };
+
+    // Hash the cache is keyed on. FNV-1a, over the whole source
+    static std::uint64_t hash(std::string_view source){
+        std::uint64_t hash = 14695981039346656037ull;
+        for(unsigned char c : source){
+            hash ^= c;
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    // Map `path` and rebuild the program it holds. False if there is no usable cache of exactly `source`
+    // compiled with `options`
+    bool load(const std::string& path, std::string_view source, const Options& options){
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if(fd < 0) return false;
+        bool loaded = file.load(fd);
+        ::close(fd);
+        if(!loaded) return false;
+
+        std::string_view contents = file.view();
+        Header header;
+        if(contents.size() < sizeof(Header)) return false;
+        std::memcpy(&header, contents.data(), sizeof(Header));
+
+        if(std::memcmp(header.magic, magic, sizeof(header.magic)) != 0 || header.version != version
+           || header.sourceSize != source.size() || header.sourceHash != hash(source) || !(header.options == options)){
+            return false;
+        }
+
+        // No count can exceed the file size, which keeps the sum below from overflowing. Indices are 32 bit
+        for(std::uint64_t count : {header.nodes, header.lists, header.locations, header.constants, header.texts, header.bytes}){
+            if(count > contents.size() || count >= FlatAst::NO_NODE) return false;
+        }
+        // Every global is named by some node, and the interpreter allocates them all up front
+        if(header.globals > header.nodes) return false;
+        std::uint64_t expected = sizeof(Header) + header.nodes * sizeof(StoredNode) + header.lists * sizeof(std::uint32_t)
+                               + header.locations * sizeof(StoredLocation) + header.constants * sizeof(StoredConstant)
+                               + header.texts * sizeof(StoredText) + header.bytes;
+        if(contents.size() != expected) return false;
+
+        const char* cursor = contents.data() + sizeof(Header);
+        ast = FlatAst{};
+        ast.program = {header.programFirst, header.programCount};
+        ast.globals = header.globals;
+        std::vector<StoredNode> nodes;
+        read(cursor, nodes, header.nodes);
+        read(cursor, ast.lists, header.lists);
+
+        ast.nodes.reserve(nodes.size());
+        for(const StoredNode& node : nodes){
+            ast.nodes.push_back(FlatNode{static_cast<NodeKind>(node.kind), static_cast<TokenType>(node.op), node.a, node.b, node.c, node.loc});
+        }
+
+        std::vector<StoredLocation> locations;
+        std::vector<StoredConstant> constants;
+        std::vector<StoredText> stored;
+        read(cursor, locations, header.locations);
+        read(cursor, constants, header.constants);
+        read(cursor, stored, header.texts);
+        std::string_view bytes(cursor, header.bytes);
+
+        std::vector<std::string_view> texts;
+        std::vector<Symbol> symbols(stored.size());
+        texts.reserve(stored.size());
+        for(std::size_t i = 0; i < stored.size(); ++i){
+            const StoredText& text = stored[i];
+            if(text.offset > bytes.size() || text.length > bytes.size() - text.offset) return false;
+            texts.push_back(bytes.substr(text.offset, text.length));
+            if(text.name) symbols[i] = intern(texts.back());
+        }
+
+        ast.locations.reserve(locations.size());
+        for(const StoredLocation& location : locations){
+            if(location.text >= texts.size()) return false;
+            ast.locations.push_back(Location{location.line, texts[location.text], symbols[location.text]});
+        }
+
+        ast.constants.reserve(constants.size());
+        for(const StoredConstant& constant : constants){
+            if(constant.type > STRING_CONSTANT || (constant.type == STRING_CONSTANT && constant.text >= texts.size())) return false;
+            switch(constant.type){
+                case NIL_CONSTANT:    ast.constants.push_back(nullptr); break;
+                case BOOL_CONSTANT:   ast.constants.push_back(constant.number != 0); break;
+                case NUMBER_CONSTANT: {
+                    double number;
+                    std::memcpy(&number, &constant.number, sizeof(number));
+                    ast.constants.push_back(number);
+                    break;
+                }
+                default:              ast.constants.push_back(intern(texts[constant.text])); break;
+            }
+        }
+
+        return consistent();
+    }
+
+    const FlatAst& program() const {
+        return ast;
+    }
+
+    // Write `program`, compiled from `source` with `options`, to `path`. False (leaving no file behind) if it can't be written
+    static bool save(const std::string& path, const FlatAst& program, std::string_view source, const Options& options){
+        Writer writer;
+        std::vector<StoredNode> nodes;
+        std::vector<StoredLocation> locations;
+        std::vector<StoredConstant> constants;
+
+        nodes.reserve(program.nodes.size());
+        for(const FlatNode& node : program.nodes){
+            nodes.push_back(StoredNode{node.kind, node.op, 0, node.a, node.b, node.c, node.loc});
+        }
+
+        locations.reserve(program.locations.size());
+        for(const Location& location : program.locations){
+            locations.push_back(StoredLocation{location.line, writer.text(location.lexeme, location.symbol.text != nullptr)});
+        }
+
+        constants.reserve(program.constants.size());
+        for(const Value& value : program.constants){
+            StoredConstant constant{};
+            if(std::holds_alternative<bool>(value)){
+                constant.type = BOOL_CONSTANT;
+                constant.number = std::get<bool>(value) ? 1 : 0;
+            }
+            else if(std::holds_alternative<double>(value)){
+                constant.type = NUMBER_CONSTANT;
+                std::memcpy(&constant.number, &std::get<double>(value), sizeof(double));
+            }
+            else if(std::holds_alternative<Symbol>(value)){
+                constant.type = STRING_CONSTANT;
+                constant.text = writer.text(std::get<Symbol>(value).str(), false);
+            }
+            else if(std::holds_alternative<std::string>(value)){
+                constant.type = STRING_CONSTANT;
+                constant.text = writer.text(std::get<std::string>(value), false);
+            }
+            else constant.type = NIL_CONSTANT;
+            constants.push_back(constant);
+        }
+
+        Header header{};
+        std::memcpy(header.magic, magic, sizeof(header.magic));
+        header.version = version;
+        header.sourceSize = source.size();
+        header.sourceHash = hash(source);
+        header.options = options;
+        header.nodes = nodes.size();
+        header.lists = program.lists.size();
+        header.locations = locations.size();
+        header.constants = constants.size();
+        header.texts = writer.texts.size();
+        header.bytes = writer.bytes.size();
+        header.programFirst = program.program.first;
+        header.programCount = program.program.count;
+        header.globals = program.globals;
+
+        std::string temporary = path + ".tmp" + std::to_string(::getpid());
+        std::FILE* out = std::fopen(temporary.c_str(), "wb");
+        if(out == nullptr) return false;
+
+        bool written = write(out, &header, 1) && write(out, nodes.data(), nodes.size())
+                    && write(out, program.lists.data(), program.lists.size())
+                    && write(out, locations.data(), locations.size()) && write(out, constants.data(), constants.size())
+                    && write(out, writer.texts.data(), writer.texts.size())
+                    && write(out, writer.bytes.data(), writer.bytes.size());
+        written = std::fclose(out) == 0 && written;
+
+        if(!written || std::rename(temporary.c_str(), path.c_str()) != 0){
+            std::remove(temporary.c_str());
+            return false;
+        }
+        return true;
+    }
+
+private:
+    static constexpr char magic[4] = {'L', 'O', 'X', 'C'};
+
+    enum ConstantType : std::uint32_t { NIL_CONSTANT, BOOL_CONSTANT, NUMBER_CONSTANT, STRING_CONSTANT };
+
+    struct Header {
+        char magic[4];
+        std::uint32_t version;
+        std::uint64_t sourceSize;
+        std::uint64_t sourceHash;
+        Options options;
+        std::uint64_t nodes, lists, locations, constants, texts, bytes;
+        std::uint32_t programFirst, programCount;
+        std::uint32_t globals;
+        std::uint32_t unused;  // 0, takes the place of the padding
+    };
+
+    // A FlatNode without its padding
+    struct StoredNode {
+        std::uint8_t kind, op;
+        std::uint16_t unused;  // 0
+        std::uint32_t a, b, c;
+        std::uint32_t loc;
+    };
+
+    struct StoredText {
+        std::uint32_t offset;  // slice of the bytes
+        std::uint32_t length : 31;
+        std::uint32_t name : 1;   // an identifier, its location gets the interned Symbol
+    };
+
+    struct StoredLocation {
+        std::int32_t line;
+        std::uint32_t text;
+    };
+
+    struct StoredConstant {
+        ConstantType type;
+        std::uint32_t text;    // strings
+        std::uint64_t number;  // the bits of a number, 0 or 1 for a boolean
+    };
+
+    // The records are written out byte for byte : no padding (whose bytes are left over from whatever was
+    // in memory before, so two runs would write different files) and a single representation per value
+    static_assert(std::has_unique_object_representations_v<Header>, "Header must have no padding");
+    static_assert(std::has_unique_object_representations_v<StoredNode>, "StoredNode must have no padding");
+    static_assert(std::has_unique_object_representations_v<StoredText>, "StoredText must have no padding");
+    static_assert(std::has_unique_object_representations_v<StoredLocation>, "StoredLocation must have no padding");
+    static_assert(std::has_unique_object_representations_v<StoredConstant>, "StoredConstant must have no padding");
+
+    // Builds the tables of texts, storing each distinct one once
+    struct Writer {
+        std::vector<StoredText> texts;
+        std::string bytes;
+        std::unordered_map<std::string_view, std::uint32_t> index[2];  // plain texts, names
+
+        std::uint32_t text(std::string_view text, bool name){
+            auto it = index[name].find(text);
+            if(it != index[name].end()) return it->second;
+
+            texts.push_back(StoredText{static_cast<std::uint32_t>(bytes.size()), static_cast<std::uint32_t>(text.size()), name});
+            bytes.append(text);
+            index[name].emplace(text, static_cast<std::uint32_t>(texts.size() - 1));
+            return static_cast<std::uint32_t>(texts.size() - 1);
+        }
+    };
+
+    // Whether the loaded program is one the Flattener could have made, so the interpreter can follow every
+    // index without checks : nodes in post-order (children before parents, so no cycles), each reached once from
+    // the program, operands of the right kind, tables and list ranges in bounds, expressions evaluated by
+    // recursion no taller than FlatAst::deepHeight, and every slot inside the globals or a block that is open there
+    bool consistent() const {
+        const std::vector<FlatNode>& nodes = ast.nodes;
+        auto inLists = [&](std::uint32_t first, std::uint32_t count){
+            return first <= ast.lists.size() && count <= ast.lists.size() - first;
+        };
+        auto isExpression = [&](std::uint32_t index, std::uint32_t parent){
+            return index < parent && nodes[index].kind <= DEEP;
+        };
+        auto isStatement = [&](std::uint32_t index, std::uint32_t parent){
+            return index < parent && nodes[index].kind >= EXPRESSION_STMT && nodes[index].kind <= WHILE_STMT;
+        };
+        auto optional = [](std::uint32_t index, bool valid){
+            return index == FlatAst::NO_NODE || valid;
+        };
+
+        // Operands, in index order. heights[i] is what evaluating node i recursively takes (1 for a DEEP node,
+        // which switches to the explicit stack)
+        std::vector<std::uint32_t> heights(nodes.size(), 1);
+        for(std::uint32_t i = 0; i < nodes.size(); ++i){
+            const FlatNode& node = nodes[i];
+            if(node.loc != FlatAst::NO_NODE && node.loc >= ast.locations.size()) return false;
+            // Named nodes and operators rebuild their token for lookups and errors
+            if(node.loc == FlatAst::NO_NODE && node.kind != LITERAL && node.kind != DEEP && node.kind < EXPRESSION_STMT) return false;
+            if(node.kind == VAR_STMT && node.loc == FlatAst::NO_NODE) return false;
+
+            std::uint32_t height = 0;
+            auto operand = [&](std::uint32_t index){
+                if(!isExpression(index, i)) return false;
+                height = std::max(height, heights[index]);
+                return true;
+            };
+            // A statement evaluates its expression from scratch, on the native stack unless it is DEEP
+            auto root = [&](std::uint32_t index){
+                return isExpression(index, i) && (nodes[index].kind == DEEP || heights[index] <= FlatAst::deepHeight);
+            };
+
+            bool valid = true;
+            switch(node.kind){
+                case LITERAL:  valid = node.a < ast.constants.size(); break;
+                case VARIABLE: break;
+                case ASSIGN:
+                case UNARY:    valid = operand(node.a); break;
+                case BINARY:
+                case LOGICAL:  valid = operand(node.a) && operand(node.b); break;
+                case TERNARY:  valid = operand(node.a) && operand(node.b) && operand(node.c); break;
+                case DEEP:     valid = isExpression(node.a, i); height = 0; break;
+
+                case EXPRESSION_STMT:
+                case PRINT_STMT: valid = root(node.a); break;
+                case VAR_STMT:   valid = optional(node.a, root(node.a)); break;
+                case IF_STMT:    valid = root(node.a) && isStatement(node.b, i) && optional(node.c, isStatement(node.c, i)); break;
+                case WHILE_STMT: valid = root(node.a) && isStatement(node.b, i); break;
+                case BLOCK_STMT: {
+                    valid = inLists(node.a, node.b);
+                    for(std::uint32_t entry = 0; valid && entry < node.b; ++entry) valid = isStatement(ast.lists[node.a + entry], i);
+                    break;
+                }
+                default: valid = false; break;
+            }
+            if(!valid) return false;
+            heights[i] = height + 1;
+        }
+
+        if(!inLists(ast.program.first, ast.program.count)) return false;
+
+        // Slots, walking down from the program with the slot counts of the blocks open at each node (innermost
+        // last), the same frames the Environment will have. A FRAME entry closes a block
+        constexpr std::uint32_t FRAME = FlatAst::NO_NODE;
+        std::vector<std::uint32_t> pending, frames;
+        std::vector<bool> reached(nodes.size(), false);
+        for(std::uint32_t entry = 0; entry < ast.program.count; ++entry){
+            pending.push_back(ast.lists[ast.program.first + entry]);
+            if(!isStatement(pending.back(), static_cast<std::uint32_t>(nodes.size()))) return false;
+        }
+
+        while(!pending.empty()){
+            std::uint32_t index = pending.back();
+            pending.pop_back();
+            if(index == FRAME){
+                frames.pop_back();
+                continue;
+            }
+            if(reached[index]) return false;
+            reached[index] = true;
+
+            const FlatNode& node = nodes[index];
+            if(node.kind == VARIABLE || node.kind == ASSIGN || node.kind == VAR_STMT){
+                bool global = node.b == Resolver::GLOBAL;
+                if(global ? node.c >= ast.globals : node.b >= frames.size() || node.c >= frames[frames.size() - 1 - node.b]) return false;
+            }
+
+            if(node.kind == BLOCK_STMT){
+                frames.push_back(node.c);
+                pending.push_back(FRAME);
+                for(std::uint32_t entry = 0; entry < node.b; ++entry) pending.push_back(ast.lists[node.a + entry]);
+                continue;
+            }
+
+            // Only the operands checked above : the others may hold anything
+            std::uint32_t operands = 0;
+            switch(node.kind){
+                case LITERAL: case VARIABLE:                                    break;
+                case ASSIGN: case UNARY: case DEEP: case EXPRESSION_STMT:
+                case PRINT_STMT: case VAR_STMT:                       operands = 1; break;
+                case BINARY: case LOGICAL: case WHILE_STMT:           operands = 2; break;
+                default:                                              operands = 3; break;
+            }
+            for(std::uint32_t child : {node.a, node.b, node.c}){
+                if(operands-- == 0) break;
+                if(child != FlatAst::NO_NODE) pending.push_back(child);
+            }
+        }
+
+        return true;
+    }
+
+    template <class T>
+    static bool write(std::FILE* out, const T* data, std::size_t count){
+        return count == 0 || std::fwrite(data, sizeof(T), count, out) == count;
+    }
+
+    template <class T>
+    static void read(const char*& cursor, std::vector<T>& table, std::size_t count){
+        table.resize(count);
+        if(count != 0) std::memcpy(table.data(), cursor, count * sizeof(T));
+        cursor += count * sizeof(T);
+    }
+
+    SourceBuffer file;
+    FlatAst ast;
+};
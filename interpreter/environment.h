@@ -1,57 +1,62 @@
 #pragma once
 
-#include<unordered_map>
-#include<iostream>
-#include<any>
+#include<cstdint>
 #include<string>
-#include"../utils/error.h"
+#include<vector>
+#include"../utils/runtimeError.h"
 #include"../scanner/token.h"
+#include"../utils/value.h"
+#include"resolver.h"
 
-class Environment: public std::enable_shared_from_this<Environment> {
+/*
+Storage of the variables, addressed by the (depth, slot) the Resolver gave each access.
 
-public:
+Blocks can't outlive their execution (no closures), so the locals of every active block sit in one value
+stack : entering a block pushes a frame of its slot count, leaving it pops the frame. A local is then
+frames[depth from the top] + slot, no hashing and no heap allocation per block.
+Globals are one array for the program. They may be read before (or without) being defined, so they carry a flag.
+*/
+class Environment {
 
-    Environment() : enclosing(nullptr) {}
-    
-    Environment(std::shared_ptr<Environment> _enclosing) : enclosing(_enclosing) {}
+public:
+    explicit Environment(std::uint32_t globalCount = 0) : globals(globalCount), defined(globalCount, false) {}
 
-    void define(std::string name, std::any value){
-        values[name] = std::move(value);
+    // Enter / leave a block using `slots` locals
+    void push(std::uint32_t slots){
+        frames.push_back(static_cast<std::uint32_t>(stack.size()));
+        stack.resize(stack.size() + slots);
     }
-    
-    std::any get(Token name){
-        if(values.find(name.lexeme) != values.end()){
-            return values[name.lexeme];
-        }
 
-        // If variable is not in current local scope, look for it in the outer scope
-        if(enclosing != nullptr){
-            return enclosing->get(name);
-        }
+    void pop(){
+        stack.resize(frames.back());
+        frames.pop_back();
+    }
 
-        throw RuntimeError(name, "Undefined variable '" + name.lexeme + "'.");
+    void define(std::uint32_t depth, std::uint32_t slot, Value value){
+        if(depth == Resolver::GLOBAL) defined[slot] = true;
+        *at(depth, slot) = std::move(value);
+    }
 
+    // nullptr if it is a global that was not defined (yet)
+    Value* lookup(std::uint32_t depth, std::uint32_t slot){
+        if(depth == Resolver::GLOBAL && !defined[slot]) return nullptr;
+        return at(depth, slot);
     }
 
-    void assign(Token name, std::any value){
-        if(values.find(name.lexeme) != values.end()){
-            values[name.lexeme] = value;
-            return;
-        }
-        
-        // If variable is not in current local scope, look for it in the outer scope
-        if(enclosing != nullptr){
-            enclosing->assign(name,value);
-            return;
-        }
-
-        throw RuntimeError(name, "Undefined variable '" + name.lexeme + "'.");
+    static RuntimeError undefined(const Token& name){
+        return RuntimeError(name, "Undefined variable '" + std::string(name.lexeme) + "'.");
     }
 
 
 private:
-    std::unordered_map<std::string,std::any> values;
-    // Reference to parent environment for each nested env.
-    std::shared_ptr<Environment> enclosing;
-};  
-
+    std::vector<Value> globals;
+    std::vector<bool> defined;
+    // Locals of the active blocks, and where each block's frame starts
+    std::vector<Value> stack;
+    std::vector<std::uint32_t> frames;
+
+    Value* at(std::uint32_t depth, std::uint32_t slot){
+        if(depth == Resolver::GLOBAL) return &globals[slot];
+        return &stack[frames[frames.size() - 1 - depth] + slot];
+    }
+};
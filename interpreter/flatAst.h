@@ -0,0 +1,306 @@
+#pragma once
+
+#include<algorithm>
+#include<cstdint>
+#include<string_view>
+#include<vector>
+#include"../scanner/Expr.h"
+#include"../scanner/token.h"
+#include"../utils/interner.h"
+#include"../utils/tokenType.h"
+#include"../utils/value.h"
+#include"Stmt.h"
+#include"resolver.h"
+
+/*
+Data oriented form of the AST that the interpreter runs on.
+
+    - Every node (expressions and statements) sits in one contiguous vector, in post-order : children before parents
+    - Children are 32 bit indices into that vector instead of pointers
+    - The operator is the 1 byte TokenType, the rest of the token (line, lexeme, name) lives in a side
+      `locations` table that is only read for variables and errors
+    - Literal values live in a `constants` table, block bodies as index ranges into `lists`
+
+A node is 20 bytes, against ~100 bytes for a pointer linked Binary carrying a full Token.
+Grouping nodes are dropped while flattening : the parentheses are already encoded by the shape of the tree.
+Variable names are resolved while flattening too (see resolver.h) : named nodes carry their scope depth and slot.
+*/
+
+enum NodeKind : std::uint8_t {
+    // Expressions
+    LITERAL, VARIABLE, ASSIGN, UNARY, BINARY, LOGICAL, TERNARY, DEEP,
+    // Statements
+    EXPRESSION_STMT, PRINT_STMT, VAR_STMT, BLOCK_STMT, IF_STMT, WHILE_STMT,
+};
+
+/*
+Meaning of the operands per kind (NO_NODE when absent) :
+    LITERAL  a = constant          VARIABLE  b = depth, c = slot  ASSIGN  a = value, b = depth, c = slot
+    UNARY    a = right             BINARY / LOGICAL  a = left, b = right
+    TERNARY  a = left, b = middle, c = right                      DEEP  a = expression (see FlatAst::deepHeight)
+    EXPRESSION_STMT / PRINT_STMT  a = expression                  VAR_STMT  a = initializer, b = depth, c = slot
+    BLOCK_STMT  a = first entry in lists, b = count, c = slots    IF_STMT  a = condition, b = then, c = else
+    WHILE_STMT  a = condition, b = body
+The depth of a global is Resolver::GLOBAL, its slot indexes the program's globals. Named nodes keep their name in loc
+*/
+struct FlatNode {
+    NodeKind kind;
+    TokenType op;      // operator (or IDENTIFIER for named nodes)
+    std::uint32_t a, b, c;
+    std::uint32_t loc; // index into FlatAst::locations
+};
+
+static_assert(sizeof(FlatNode) <= 20, "FlatNode should stay small enough to pack 3 per cache line");
+
+// Where a node came from, only touched on lookups by name and when reporting errors
+struct Location {
+    int line;
+    std::string_view lexeme;
+    Symbol symbol;
+};
+
+struct FlatAst {
+    static constexpr std::uint32_t NO_NODE = UINT32_MAX;
+
+    // Expressions taller than this are wrapped in a DEEP node : the interpreter evaluates them with an
+    // explicit stack instead of recursing once per level on the native stack
+    static constexpr std::uint32_t deepHeight = 1000;
+
+    struct Range {
+        std::uint32_t first = 0;
+        std::uint32_t count = 0;
+    };
+
+    std::vector<FlatNode> nodes;
+    std::vector<Location> locations;
+    std::vector<Value> constants;
+    std::vector<std::uint32_t> lists;
+    Range program;  // top level statements
+    std::uint32_t globals = 0;  // number of global slots
+
+    const FlatNode& operator[](std::uint32_t index) const {
+        return nodes[index];
+    }
+
+    const std::uint32_t* begin(Range range) const {
+        return lists.data() + range.first;
+    }
+
+    const std::uint32_t* end(Range range) const {
+        return lists.data() + range.first + range.count;
+    }
+
+    const Location& location(const FlatNode& node) const {
+        return locations[node.loc];
+    }
+
+    // Rebuild the token a node was made from (for error reporting and printing)
+    Token token(const FlatNode& node) const {
+        const Location& where = locations[node.loc];
+        return Token(node.op, where.lexeme, nullptr, where.line, where.symbol);
+    }
+};
+
+/*
+Lowers the pointer AST produced by the parser into a FlatAst, with a single post-order walk.
+The pointer tree (and the source its tokens view) must stay alive while the flat one is used.
+*/
+class Flattener : public ExprVisitor<Flattener, std::uint32_t>, public StmtVisitor<Flattener, std::uint32_t> {
+
+public:
+    using ExprVisitor::visit;
+    using StmtVisitor::visit;
+
+    FlatAst flatten(const std::vector<const Stmt*>& statements){
+        ast = FlatAst{};
+        heights.clear();
+        resolver.reset();
+        ast.program = list(statements);
+        ast.globals = resolver.globalCount();
+        return std::move(ast);
+    }
+
+    // Same, for top level statements parsed at different times (see Document) : the lines recorded in
+    // statement i are off by lineShifts[i], which is added back to every location
+    FlatAst flatten(const std::vector<const Stmt*>& statements, const std::vector<int>& lineShifts){
+        ast = FlatAst{};
+        heights.clear();
+        resolver.reset();
+
+        std::vector<std::uint32_t> entries;
+        entries.reserve(statements.size());
+        for(std::size_t i = 0; i < statements.size(); ++i){
+            lineShift = lineShifts[i];
+            entries.push_back(flatten(statements[i]));
+        }
+        lineShift = 0;
+
+        ast.program = append(entries);
+        ast.globals = resolver.globalCount();
+        return std::move(ast);
+    }
+
+    std::uint32_t visitBlockStmt(const Block* stmt) {
+        resolver.beginScope();
+        FlatAst::Range body = list(stmt->statements);
+        return push(BLOCK_STMT, NIL, body.first, body.count, resolver.endScope());
+    }
+
+    std::uint32_t visitExpressionStmt(const Expression* stmt) {
+        return push(EXPRESSION_STMT, NIL, expression(stmt->expression));
+    }
+
+    std::uint32_t visitIfStmt(const If* stmt) {
+        std::uint32_t condition = expression(stmt->condition);
+        std::uint32_t thenBranch = flatten(stmt->thenBranch);
+        std::uint32_t elseBranch = flatten(stmt->elseBranch);
+        return push(IF_STMT, NIL, condition, thenBranch, elseBranch);
+    }
+
+    std::uint32_t visitPrintStmt(const Print* stmt) {
+        return push(PRINT_STMT, NIL, expression(stmt->expression));
+    }
+
+    std::uint32_t visitVarStmt(const Var* stmt) {
+        // The initializer still sees an outer variable of the same name
+        std::uint32_t initializer = expression(stmt->initializer);
+        Resolver::Slot slot = resolver.declare(stmt->name.symbol);
+        return push(VAR_STMT, IDENTIFIER, initializer, slot.depth, slot.index, location(stmt->name));
+    }
+
+    std::uint32_t visitWhileStmt(const While* stmt) {
+        std::uint32_t condition = expression(stmt->condition);
+        std::uint32_t body = flatten(stmt->body);
+        return push(WHILE_STMT, NIL, condition, body);
+    }
+
+    std::uint32_t visitAssignExpr(const Assign* expr) {
+        std::uint32_t value = flatten(expr->value);
+        Resolver::Slot slot = resolver.resolve(expr->name.symbol);
+        return push(ASSIGN, IDENTIFIER, value, slot.depth, slot.index, location(expr->name));
+    }
+
+    std::uint32_t visitBinaryExpr(const Binary* expr) {
+        return leftSpine(expr);
+    }
+
+    std::uint32_t visitLogicalExpr(const Logical* expr) {
+        return leftSpine(expr);
+    }
+
+    std::uint32_t visitUnaryExpr(const Unary* expr) {
+        return push(UNARY, expr->op.type, flatten(expr->right), FlatAst::NO_NODE, FlatAst::NO_NODE, location(expr->op));
+    }
+
+    std::uint32_t visitLiteralExpr(const Literal* expr) {
+        ast.constants.push_back(expr->value);
+        return push(LITERAL, NIL, static_cast<std::uint32_t>(ast.constants.size() - 1));
+    }
+
+    // The parentheses only matter for the shape of the tree, which the indices already capture
+    std::uint32_t visitGroupingExpr(const Grouping* expr) {
+        return flatten(expr->expression);
+    }
+
+    std::uint32_t visitTernaryExpr(const Ternary* expr) {
+        std::uint32_t left = flatten(expr->left);
+        std::uint32_t middle = flatten(expr->middle);
+        std::uint32_t right = flatten(expr->right);
+        return push(TERNARY, expr->leftOp.type, left, middle, right, location(expr->leftOp));
+    }
+
+    std::uint32_t visitVariableExpr(const Variable* expr) {
+        Resolver::Slot slot = resolver.resolve(expr->name.symbol);
+        return push(VARIABLE, IDENTIFIER, FlatAst::NO_NODE, slot.depth, slot.index, location(expr->name));
+    }
+
+private:
+    FlatAst ast;
+    // Height of each expression node (1 for leaves), only needed while flattening
+    std::vector<std::uint32_t> heights;
+    int lineShift = 0;
+    Resolver resolver;
+
+    // Statements reach their expressions through here : the root of a tree too tall for the
+    // recursive evaluator gets marked with a DEEP node
+    std::uint32_t expression(const Expr* expr){
+        std::uint32_t root = flatten(expr);
+        if(root != FlatAst::NO_NODE && heights[root] > FlatAst::deepHeight) return push(DEEP, NIL, root);
+        return root;
+    }
+
+    // A chain like a + b + c + ... parses (without recursion) into a left leaning spine of Binary/Logical
+    // nodes that can be a million deep. Walk down the spine with a loop instead of recursing into every
+    // left operand, then emit the nodes bottom up : same post-order as the recursive walk
+    std::uint32_t leftSpine(const Expr* expr){
+        std::vector<const Expr*> spine;
+        while(expr->kind == ExprKind::Binary || expr->kind == ExprKind::Logical){
+            spine.push_back(expr);
+            expr = expr->kind == ExprKind::Binary ? static_cast<const Binary*>(expr)->left : static_cast<const Logical*>(expr)->left;
+        }
+
+        std::uint32_t left = flatten(expr);
+        for(auto it = spine.rbegin(); it != spine.rend(); ++it){
+            if((*it)->kind == ExprKind::Binary){
+                const Binary* binary = static_cast<const Binary*>(*it);
+                std::uint32_t right = flatten(binary->right);
+                left = push(BINARY, binary->op.type, left, right, FlatAst::NO_NODE, location(binary->op));
+            }
+            else{
+                const Logical* logical = static_cast<const Logical*>(*it);
+                std::uint32_t right = flatten(logical->right);
+                left = push(LOGICAL, logical->op.type, left, right, FlatAst::NO_NODE, location(logical->op));
+            }
+        }
+        return left;
+    }
+
+    std::uint32_t flatten(const Expr* expr){
+        if(expr == nullptr) return FlatAst::NO_NODE;
+        return visit(expr);
+    }
+
+    std::uint32_t flatten(const Stmt* stmt){
+        if(stmt == nullptr) return FlatAst::NO_NODE;
+        return visit(stmt);
+    }
+
+    // Nested blocks append their own lists while we walk, so the entries are collected first
+    // and copied into one contiguous range at the end
+    FlatAst::Range list(const std::vector<const Stmt*>& statements){
+        std::vector<std::uint32_t> entries;
+        entries.reserve(statements.size());
+        for(const Stmt* statement : statements){
+            entries.push_back(flatten(statement));
+        }
+
+        return append(entries);
+    }
+
+    FlatAst::Range append(const std::vector<std::uint32_t>& entries){
+        FlatAst::Range range{static_cast<std::uint32_t>(ast.lists.size()), static_cast<std::uint32_t>(entries.size())};
+        ast.lists.insert(ast.lists.end(), entries.begin(), entries.end());
+        return range;
+    }
+
+    std::uint32_t location(const Token& token){
+        ast.locations.push_back(Location{token.line + lineShift, token.lexeme, token.symbol});
+        return static_cast<std::uint32_t>(ast.locations.size() - 1);
+    }
+
+    std::uint32_t push(NodeKind kind, TokenType op, std::uint32_t a, std::uint32_t b = FlatAst::NO_NODE,
+                       std::uint32_t c = FlatAst::NO_NODE, std::uint32_t loc = FlatAst::NO_NODE){
+        ast.nodes.push_back(FlatNode{kind, op, a, b, c, loc});
+
+        std::uint32_t height = 1;
+        if(kind != LITERAL && kind < EXPRESSION_STMT){
+            bool named = kind == VARIABLE || kind == ASSIGN;  // their b and c are a slot, not children
+            for(std::uint32_t child : {a, named ? FlatAst::NO_NODE : b, named ? FlatAst::NO_NODE : c}){
+                if(child != FlatAst::NO_NODE) height = std::max(height, heights[child] + 1);
+            }
+        }
+        heights.push_back(height);
+
+        return static_cast<std::uint32_t>(ast.nodes.size() - 1);
+    }
+};
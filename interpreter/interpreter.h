@@ -1,29 +1,34 @@
 #pragma once
 
 #include<iostream>
+#include<cstdint>
+#include<memory>
 #include<sstream>
 #include<string>
-#include"../scanner/Expr.h"
+#include<variant>
 #include"../scanner/token.h"
 #include"../utils/runtimeError.h"
+#include"../utils/value.h"
 #include"environment.h"
-#include<type_traits>
-#include<any>
+#include"flatAst.h"
 
 /*
 Scanner and Parser together will create Abstract Syntax Trees according to the grammar
 
-Interpreter follows visitor pattern and computes all expressions in the tree by visiting nodes in a post-order fashion (L->R->Node)
+The tree is flattened (see flatAst.h) before it gets here : the interpreter walks the contiguous node array,
+switching on each node's kind, and computes all expressions in a post-order fashion (L->R->Node)
 
 */
 
-class Interpreter : public ExprVisitor, public StmtVisitor {
+class Interpreter {
 
 public:
-    void interpret(std::vector<std::shared_ptr<Stmt>>& statements){
+    void interpret(const FlatAst& program){
+        ast = &program;
+        environment = Environment(program.globals);
         try {
-            for(const std::shared_ptr<Stmt>& statement : statements){
-                execute(statement);
+            for(const std::uint32_t* it = ast->begin(ast->program); it != ast->end(ast->program); ++it){
+                execute(*it);
             }
         }
         catch (RuntimeError error){
@@ -31,97 +36,254 @@ public:
         }
     }
 
-    std::any visitBlockStmt(std::shared_ptr<Block> stmt) override {
-        // Create a new environment with the current one as enclosing (For nesting/shadowing)
-        executeBlock(stmt->statements, std::make_shared<Environment>(environment) );
-        return {};
-    }
+private:
 
-    std::any visitIfStmt(std::shared_ptr<If> stmt) override {
-        if(isTruthy(evaluate(stmt->condition))) {
-            execute(stmt->thenBranch);
-        } else if (stmt->elseBranch != nullptr) {
-            execute(stmt->elseBranch);
-        }
+    Environment environment;
+    const FlatAst* ast = nullptr;
 
-        return {};
-    }
+    void execute(std::uint32_t index){
+        const FlatNode& stmt = (*ast)[index];
 
-    std::any visitExpressionStmt(std::shared_ptr<Expression> stmt) override {
-        // Statements do not produce values, so we evaluate the expression and dont return anythin
-        evaluate(stmt->expression);
-        return {};
-    }
+        switch(stmt.kind){
+            case(BLOCK_STMT): {
+                // The block gets a frame of its own for its locals (For nesting/shadowing)
+                executeBlock(FlatAst::Range{stmt.a, stmt.b}, stmt.c);
+                return;
+            }
+
+            case(IF_STMT): {
+                if(isTruthy(evaluate(stmt.a))) {
+                    execute(stmt.b);
+                } else if (stmt.c != FlatAst::NO_NODE) {
+                    execute(stmt.c);
+                }
+                return;
+            }
+
+            case(EXPRESSION_STMT): {
+                // Statements do not produce values, so we evaluate the expression and dont return anythin
+                evaluate(stmt.a);
+                return;
+            }
+
+            case(PRINT_STMT): {
+                // Print the evaluated expression
+                Value value = evaluate(stmt.a);
+                std::cout << stringify(value) << std::endl;
+                return;
+            }
 
-    std::any visitPrintStmt(std::shared_ptr<Print> stmt) override {
-        // Print the evaluated expression
-        std::any value = evaluate(stmt->expression);
-        std::cout << stringify(value) << std::endl;
-        return {};
+            // Evaluate and store a variable declaration
+            case(VAR_STMT): {
+                Value value = nullptr;
+
+                if(stmt.a != FlatAst::NO_NODE) {
+                    value = evaluate(stmt.a);
+                }
+                environment.define(stmt.b, stmt.c, std::move(value));
+                return;
+            }
+
+            // Evaluate while control flow
+            case(WHILE_STMT): {
+                while(isTruthy(evaluate(stmt.a))) {
+                    execute(stmt.b);
+                }
+                return;
+            }
+
+            default: break;
+        }
     }
 
-    // Evaluate and store a variable declaration
-    std::any visitVarStmt(std::shared_ptr<Var> stmt) override {
-        std::any value = nullptr;
-        
-        if(stmt->initializer != nullptr) {
-            value = evaluate(stmt->initializer);
+    // Execute a list of statements in a new frame of `slots` locals
+    void executeBlock(FlatAst::Range statements, std::uint32_t slots){
+        environment.push(slots);
+        // Try and catch used here to restore the state even if the program fails
+        // Throw the error after restoring
+        try{
+            for(const std::uint32_t* it = ast->begin(statements); it != ast->end(statements); ++it)
+                execute(*it);
+
+        } catch(...) {
+            environment.pop();
+            throw;
         }
-        environment->define(stmt->name.lexeme,std::move(value));
 
-        return {};
+        environment.pop();
     }
 
-    // Evaluate while control flow
-    std::any visitWhileStmt(std::shared_ptr<While> stmt) override {
-        while(isTruthy(evaluate(stmt->condition))) {
-            execute(stmt->body);
+    // Computes an expression by visiting its operands first (post-order : L->R->Node)
+    // Ordinary code recurses on the native stack (fastest). The flattener wraps expressions too tall for
+    // that (a + b + c ... with a million terms) in a DEEP node, which runs them on an explicit stack instead
+    Value evaluate(std::uint32_t index){
+        const FlatNode& expr = (*ast)[index];
+
+        switch(expr.kind){
+            // Evaluate Literals : directly return value
+            case(LITERAL): return ast->constants[expr.a];
+
+            // Get the value of variable from lookup table
+            case(VARIABLE): return variable(expr);
+
+            // Evaluate assignment statements
+            case(ASSIGN): {
+                Value value = evaluate(expr.a);
+                variable(expr) = value;
+                return value;
+            }
+
+            case(LOGICAL): {
+                Value left = evaluate(expr.a);
+
+                if(expr.op == OR){
+                    if(isTruthy(left)) return left; // left gives true and if its ||, we return left (true)
+                } else {
+                    if(!isTruthy(left)) return left; // left gives false and if its &&, we return left (false)
+                }
+
+                return evaluate(expr.b); // Return right finally only if all left conditions are met
+            }
+
+            case(UNARY): return unary(expr, evaluate(expr.a));
+
+            // Evaluates operands from left -> right
+            case(BINARY): {
+                Value left = evaluate(expr.a);
+                Value right = evaluate(expr.b);
+                return binary(expr, left, right);
+            }
+
+            // Evaluate ternary operations
+            case(TERNARY): {
+                // Evaluate left operand, if true : evaluate middle, else evalute right
+                Value left_eval = evaluate(expr.a);
+                if(std::get<bool>(left_eval)){
+                    return evaluate(expr.b);
+                }
+
+                return evaluate(expr.c);
+            }
+
+            case(DEEP): return evaluateIterative(expr.a);
+
+            default: break;
         }
 
-        return {};
+        return nullptr;
     }
 
-    // Evaluate assignment statements
-    std::any visitAssignExpr(std::shared_ptr<Assign> expr) override {
-        std::any value = evaluate(expr->value);
-        environment->assign(expr->name,value);
-        
-        return value;
-    }
+    // Same semantics as evaluate() (order of evaluation, short circuits, errors), but the pending work
+    // lives in `frames` and the intermediate results in `values` instead of on the native stack.
+    // Each frame remembers how many of its operands it has already asked for
+    Value evaluateIterative(std::uint32_t root){
+        struct Frame {
+            std::uint32_t node;
+            std::uint8_t step;
+        };
+
+        std::vector<Frame> frames{{root, 0}};
+        std::vector<Value> values;
+
+        while(!frames.empty()){
+            Frame& frame = frames.back();
+            const FlatNode& expr = (*ast)[frame.node];
+            std::uint8_t step = frame.step++;
+
+            switch(expr.kind){
+                case(LITERAL): {
+                    values.push_back(ast->constants[expr.a]);
+                    frames.pop_back();
+                    break;
+                }
 
+                case(VARIABLE): {
+                    values.push_back(variable(expr));
+                    frames.pop_back();
+                    break;
+                }
 
-    // Evaluate Literals : directly return value
-    std::any visitLiteralExpr(std::shared_ptr<Literal> expr) override {
-        return expr->value; // Check if we need to type_cast this before returning
-    }
+                case(ASSIGN): {
+                    if(step == 0){ frames.push_back({expr.a, 0}); break; }
+                    variable(expr) = values.back();
+                    frames.pop_back();
+                    break;
+                }
+
+                case(UNARY): {
+                    if(step == 0){ frames.push_back({expr.a, 0}); break; }
+                    values.back() = unary(expr, values.back());
+                    frames.pop_back();
+                    break;
+                }
 
-    std::any visitLogicalExpr(std::shared_ptr<Logical> expr) override {
-        std::any left = evaluate(expr->left);
+                case(BINARY): {
+                    if(step < 2){ frames.push_back({step == 0 ? expr.a : expr.b, 0}); break; }
+                    Value right = std::move(values.back());
+                    values.pop_back();
+                    values.back() = binary(expr, values.back(), right);
+                    frames.pop_back();
+                    break;
+                }
 
-        if(expr->op.type == OR){
-            if(isTruthy(left)) return left; // left gives true and if its ||, we return left (true)
-        } else {
-            if(!isTruthy(left)) return left; // left gives false and if its &&, we return left (false)
+                case(LOGICAL): {
+                    if(step == 0){ frames.push_back({expr.a, 0}); break; }
+                    if(step == 1){
+                        // The left value is the result if it short circuits, otherwise the right one replaces it
+                        bool shortCircuit = expr.op == OR ? isTruthy(values.back()) : !isTruthy(values.back());
+                        if(!shortCircuit){
+                            values.pop_back();
+                            frames.push_back({expr.b, 0});
+                            break;
+                        }
+                    }
+                    frames.pop_back();
+                    break;
+                }
+
+                case(TERNARY): {
+                    if(step == 0){ frames.push_back({expr.a, 0}); break; }
+                    if(step == 1){
+                        bool condition = std::get<bool>(values.back());
+                        values.pop_back();
+                        frames.push_back({condition ? expr.b : expr.c, 0});
+                        break;
+                    }
+                    frames.pop_back();
+                    break;
+                }
+
+                case(DEEP): {
+                    frames.pop_back();
+                    frames.push_back({expr.a, 0});
+                    break;
+                }
+
+                default: {
+                    values.push_back(nullptr);
+                    frames.pop_back();
+                    break;
+                }
+            }
         }
 
-        return evaluate(expr->right); // Return right finally only if all left conditions are met
+        return std::move(values.back());
     }
 
-    // Evaluate parentheses : recursively evaluate the expression inside 
-    std::any visitGroupingExpr(std::shared_ptr<Grouping> expr) override {
-        return evaluate(expr->expression);
+    // The storage of a variable, at the depth and slot it was resolved to
+    Value& variable(const FlatNode& expr){
+        Value* slot = environment.lookup(expr.b, expr.c);
+        if(slot == nullptr) throw Environment::undefined(ast->token(expr));
+        return *slot;
     }
 
     // Evaluate unary expressions
-    std::any visitUnaryExpr(std::shared_ptr<Unary> expr) override {
-        // Evaluate the expression on right 
-        std::any right = evaluate(expr->right);
-
+    Value unary(const FlatNode& expr, const Value& right){
         // Proceed further according to the operator type
-        switch(expr->op.type){
+        switch(expr.op){
             case(MINUS): {
-                checkNumberOperand(expr->op,right); // Check type before casting
-                return -std::any_cast<double>(right);
+                checkNumberOperand(expr,right); // Check type before casting
+                return -std::get<double>(right);
                 }
             case(BANG) : {
                 return !isTruthy(right);
@@ -132,64 +294,55 @@ public:
         return nullptr;
     }
 
-    // Get the value of variable from lookup table
-    std::any visitVariableExpr(std::shared_ptr<Variable> expr) override {
-        return environment->get(expr->name);
-    }
-
     // Evaluate binary operations
-    std::any visitBinaryExpr(std::shared_ptr<Binary> expr) override {
-        // Evaluates operands from left -> right
-        std::any left = evaluate(expr->left);
-        std::any right = evaluate(expr->right);
-
-        switch(expr->op.type){
+    Value binary(const FlatNode& expr, Value& left, Value& right){
+        switch(expr.op){
             
             ////  ARITHMETIC OPERATORS  ////
             case(MINUS): {
-                checkNumberOperand(expr->op,left,right);
-                return std::any_cast<double>(left) - std::any_cast<double>(right);
+                checkNumberOperand(expr,left,right);
+                return std::get<double>(left) - std::get<double>(right);
             }
             
             case(PLUS):{
-                if(left.type() == typeid(std::string) && right.type() == typeid(std::string)) {
-                    return std::any_cast<std::string>(left) + std::any_cast<std::string>(right);
+                if(isString(left) && isString(right)) {
+                    return asString(left) + asString(right);
                 }
-                if(left.type() == typeid(double) && right.type() == typeid(double)) {
-                    return std::any_cast<double>(left) + std::any_cast<double>(right);
+                if(std::holds_alternative<double>(left) && std::holds_alternative<double>(right)) {
+                    return std::get<double>(left) + std::get<double>(right);
                 }
-                throw RuntimeError(expr->op, "Operands must be two numbers or two strings.");
+                throw RuntimeError(ast->token(expr), "Operands must be two numbers or two strings.");
             }
             
             case(SLASH): {
-                checkNumberOperand(expr->op,left,right);
-                return std::any_cast<double>(left) / std::any_cast<double>(right);
+                checkNumberOperand(expr,left,right);
+                return std::get<double>(left) / std::get<double>(right);
             }
             
             case(STAR): {
-                checkNumberOperand(expr->op,left,right);
-                return std::any_cast<double>(left) * std::any_cast<double>(right);
+                checkNumberOperand(expr,left,right);
+                return std::get<double>(left) * std::get<double>(right);
             }
 
             ////  COMPARISION OPERATORS  ////
             case(GREATER):{
-                checkNumberOperand(expr->op,left,right);
-                return std::any_cast<double>(left) > std::any_cast<double>(right);
+                checkNumberOperand(expr,left,right);
+                return std::get<double>(left) > std::get<double>(right);
             }
 
             case(GREATER_EQUAL):{
-                checkNumberOperand(expr->op,left,right);
-                return std::any_cast<double>(left) >= std::any_cast<double>(right);
+                checkNumberOperand(expr,left,right);
+                return std::get<double>(left) >= std::get<double>(right);
             }
 
             case(LESS):{
-                checkNumberOperand(expr->op,left,right);
-                return std::any_cast<double>(left) < std::any_cast<double>(right);
+                checkNumberOperand(expr,left,right);
+                return std::get<double>(left) < std::get<double>(right);
             }
 
             case(LESS_EQUAL):{
-                checkNumberOperand(expr->op,left,right);
-                return std::any_cast<double>(left) <= std::any_cast<double>(right);
+                checkNumberOperand(expr,left,right);
+                return std::get<double>(left) <= std::get<double>(right);
             }
 
             case(EQUAL_EQUAL):{
@@ -206,102 +359,24 @@ public:
     
     }
 
-    // Evaluate ternary operations
-    std::any visitTernaryExpr(std::shared_ptr<Ternary> expr) override {
-        // Evaluate left operand, if true : evaluate middle, else evalute right
-        std::any left_eval = evaluate(expr->left);
-        if(std::any_cast<bool>(left_eval)){
-            return evaluate(expr->middle);
-        }
-
-        return evaluate(expr->right);
-    }
-
-private:
-
-    std::shared_ptr<Environment> environment{new Environment};
-    
-    void execute(std::shared_ptr<Stmt> stmt){
-        stmt->accept(*this);
-    }
-
-    // Execute a list of statements in the context of a given environment
-    void executeBlock(std::vector<std::shared_ptr<Stmt>> statements, std::shared_ptr<Environment> environment){
-        // Store the actual env. to restore the interpreter state
-        // Bcs blocks will be executed in their own environment
-
-        std::shared_ptr<Environment> previous = this->environment; 
-        // Try and catch used here to restore the state even if the program fails
-        // Throw the error after restoring
-        try{
-            // Use the newly created environment for the block
-            this->environment = environment;
-
-            for(const std::shared_ptr<Stmt>& statement : statements)
-                execute(statement);
-
-        } catch(...) {
-            this->environment = previous;
-            throw;
-        }
-
-        this->environment = previous;
-    }
-
-    std::any evaluate(std::shared_ptr<Expr> expr){
-        return expr->accept(*this);
-    }
-
-    // false and null are considered to be Falsey, rest all truthy
-    // eg. if(1) -> true ; if(null) -> false
-    bool isTruthy(const std::any& obj){
-        auto& value_type = obj.type();
-
-        if(value_type == typeid(bool)) return std::any_cast<bool>(obj);
-        if(value_type == typeid(nullptr)) return false;
-
-        return true;
-    }
-
-    bool isEqual(std::any& left, std::any& right){
-        if(left.type() == typeid(nullptr) && right.type() == typeid(nullptr)) return true;
-        if(left.type() == typeid(nullptr)) return false;
-
-        // check for string
-        if(left.type() == typeid(std::string) && right.type() == typeid(std::string)) {
-            return std::any_cast<std::string>(left) == std::any_cast<std::string>(right);
-        }
-
-        // check for double
-        if(left.type() == typeid(double) && right.type() == typeid(double)) {
-            return std::any_cast<double>(left) == std::any_cast<double>(right);
-        }
-
-        // check for bool
-        if(left.type() == typeid(bool) && right.type() == typeid(bool)) {
-            return std::any_cast<bool>(left) == std::any_cast<bool>(right);
-        }
-
-        return false;
-    }
-
-    void checkNumberOperand(Token opt, std::any operand){
-        if(operand.type() == typeid(double)) return;
+    // The operator's token is only rebuilt (from the location table) when the check fails
+    void checkNumberOperand(const FlatNode& opt, const Value& operand){
+        if(std::holds_alternative<double>(operand)) return;
 
-        throw RuntimeError(opt, "Operand must be a number.");
+        throw RuntimeError(ast->token(opt), "Operand must be a number.");
     }
 
-    void checkNumberOperand(Token opt, std::any left, std::any right){
-        if(left.type() == typeid(double) && right.type() == typeid(double)) return;
+    void checkNumberOperand(const FlatNode& opt, const Value& left, const Value& right){
+        if(std::holds_alternative<double>(left) && std::holds_alternative<double>(right)) return;
 
-        throw RuntimeError(opt, "Operand must be a number.");
+        throw RuntimeError(ast->token(opt), "Operand must be a number.");
     }
     
-    std::string stringify(const std::any& object) {
-    if (object.type() == typeid(nullptr)) return std::string("nil");
+    std::string stringify(const Value& object) {
+    if (std::holds_alternative<std::nullptr_t>(object)) return std::string("nil");
 
-    if (object.type() == typeid(double)) {
-      std::string text = std::to_string(std::any_cast<double>(object));
+    if (std::holds_alternative<double>(object)) {
+      std::string text = std::to_string(std::get<double>(object));
       if (text[text.length() - 2] == '.' &&
           text[text.length() - 1] == '0') {
         text = text.substr(0, text.length() - 2);
@@ -309,11 +384,11 @@ private:
       return text;
     }
 
-    if (object.type() == typeid(std::string)) {
-      return std::any_cast<std::string>(object);
+    if (isString(object)) {
+      return asString(object);
     }
-    if (object.type() == typeid(bool)) {
-      return std::any_cast<bool>(object) ? std::string("true") : std::string("false");
+    if (std::holds_alternative<bool>(object)) {
+      return std::get<bool>(object) ? std::string("true") : std::string("false");
     }
 
     return "Error in stringify: object type not recognized.";
@@ -0,0 +1,73 @@
+#pragma once
+
+#include<cstdint>
+#include<unordered_map>
+#include<vector>
+#include"../utils/interner.h"
+
+/*
+Static resolution of variable names, done once while flattening (see Flattener) instead of on every access.
+
+Lox blocks are the only scopes and there are no closures, so where a name lives is known from the source alone :
+    - a local is (depth, slot) : `depth` blocks out from the one the access is in, `slot` in that block's array
+    - anything not declared in an enclosing block is a global, numbered in one table for the whole program
+
+A name is resolved against the declarations seen so far, so `{ print a; var a; }` still reads an outer `a`
+before the block's own one is declared, exactly like the lookup by name did. Declaring a name again in
+the same scope reuses its slot.
+*/
+class Resolver{
+
+public:
+    static constexpr std::uint32_t GLOBAL = UINT32_MAX;  // depth of globals
+
+    struct Slot {
+        std::uint32_t depth;
+        std::uint32_t index;
+    };
+
+    void reset(){
+        scopes.clear();
+        globals.clear();
+    }
+
+    void beginScope(){
+        scopes.emplace_back();
+    }
+
+    // Number of slots the scope used
+    std::uint32_t endScope(){
+        std::uint32_t count = static_cast<std::uint32_t>(scopes.back().size());
+        scopes.pop_back();
+        return count;
+    }
+
+    // A `var` always defines in the innermost scope
+    Slot declare(Symbol name){
+        if(scopes.empty()) return Slot{GLOBAL, number(globals, name)};
+        return Slot{0, number(scopes.back(), name)};
+    }
+
+    // Innermost declaration so far, or the global of that name (which might never be defined : that is
+    // still a runtime error, at the access)
+    Slot resolve(Symbol name){
+        for(std::size_t depth = 0; depth < scopes.size(); ++depth){
+            const auto& scope = scopes[scopes.size() - 1 - depth];
+            auto it = scope.find(name);
+            if(it != scope.end()) return Slot{static_cast<std::uint32_t>(depth), it->second};
+        }
+        return Slot{GLOBAL, number(globals, name)};
+    }
+
+    std::uint32_t globalCount() const {
+        return static_cast<std::uint32_t>(globals.size());
+    }
+
+private:
+    std::vector<std::unordered_map<Symbol, std::uint32_t>> scopes;
+    std::unordered_map<Symbol, std::uint32_t> globals;
+
+    static std::uint32_t number(std::unordered_map<Symbol, std::uint32_t>& scope, Symbol name){
+        return scope.emplace(name, static_cast<std::uint32_t>(scope.size())).first->second;
+    }
+};
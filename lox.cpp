@@ -1,51 +1,135 @@
 #include<string>
+#include <cstdio>       // std::snprintf
+#include <cstdlib>      // std::atoi, std::getenv
 #include <cstring>      // std::strerror
-#include<fstream>
 #include<iostream>
+#include<string_view>
 #include<vector>
 #include"utils/error.h"
+#include"utils/sourceBuffer.h"
 #include"scanner/scanner.h"
+#include"scanner/parallelScanner.h"
 #include"parser/parser.h"
+#include"parser/parallelParser.h"
+#include"parser/document.h"
 #include"utils/AstPrinter.h"
 #include"interpreter/interpreter.h"
+#include"interpreter/astCache.h"
 #include"interpreter/Stmt.h"
+#include"optimizer/constantFolder.h"
+#include"optimizer/deadCode.h"
+#include"optimizer/loopInvariant.h"
+#include"optimizer/cse.h"
 
-std::string readFile(std::string path) {
-  std::ifstream file{path, std::ios::in | std::ios::binary |
-                                  std::ios::ate};
-  if (!file) {
+// "-" reads the script from stdin, everything else is opened as a path
+SourceBuffer readFile(const std::string& path) {
+  int fd = path == "-" ? STDIN_FILENO : ::open(path.c_str(), O_RDONLY);
+
+  SourceBuffer contents;
+  if (fd < 0 || !contents.load(fd)) {
     std::cerr << "Failed to open file " << path << ": "
               << std::strerror(errno) << "\n";
     std::exit(74);
   };
 
-  std::string contents;
-  contents.resize(file.tellg());
-
-  file.seekg(0, std::ios::beg);
-  file.read(contents.data(), contents.size());
+  if (fd != STDIN_FILENO) ::close(fd);
 
   return contents;
 }
 
-void run(std::string source){
-    Scanner scanObj(source);
-    std::vector<Token> res;
-    res = scanObj.scanTokens();
+// Nesting limit for the parser (--max-depth). The parser recurses once per level, so values far above
+// the default need a bigger native stack than the usual 8MB
+int maxDepth = Parser::defaultMaxDepth;
+
+// Compiled scripts are cached on disk unless --no-cache is given
+bool useCache = true;
+
+// --hash-cons : share identical side effect free subexpressions while parsing
+bool hashCons = false;
+
+// The tree is optimized (see optimizer/) before it runs unless --no-optimize is given
+bool optimize = true;
+
+// The flags a compiled script depends on : its cache is only used under the same ones
+AstCache::Options compileOptions(){
+    return AstCache::Options{maxDepth, optimize};
+}
+
+// Where the compiled form of a script is kept : next to it (script.lox -> script.loxc), or under
+// $LOXC_CACHE_DIR, named after the script's absolute path, when that is set
+std::string cachePath(const std::string& path){
+    const char* dir = std::getenv("LOXC_CACHE_DIR");
+    if(dir == nullptr || *dir == '\0'){
+        std::string_view stem(path);
+        if(stem.size() > 4 && stem.substr(stem.size() - 4) == ".lox") stem.remove_suffix(4);
+        return std::string(stem) + ".loxc";
+    }
+
+    char* real = ::realpath(path.c_str(), nullptr);
+    std::string absolute = real != nullptr ? real : path;
+    std::free(real);
 
-    Parser p(res);
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.loxc", static_cast<unsigned long long>(AstCache::hash(absolute)));
+    return std::string(dir) + "/" + name;
+}
+
+// source must stay alive until run returns : tokens and the AST point into it
+// A script that compiles is saved to `compiled` (when given) before it runs
+void run(std::string_view source, const std::string& compiled = {}){
+    // Large scripts are lexed on several threads, small ones fall through to the serial Scanner
+    ParallelScanner scanObj(source);
+    TokenBuffer res = scanObj.scanTokens();
+
+    // Every node of the tree lives in the arena and is released in one go when run returns
+    // Long token streams are parsed on several threads, short ones fall through to the serial Parser
+    Arena arena;
+    ParallelParser p(res, arena, maxDepth);
+    if(hashCons) p.shareSubtrees();
     // // AstPrinter pprint;
-    std::vector<std::shared_ptr<Stmt>> statements = p.parse();
+    std::vector<const Stmt*> statements = p.parse();
     // // std::cout<<pprint.print(expr);
     // // std::cout<<std::endl;
+    for(const Diagnostic& diagnostic : p.diagnostics) report(diagnostic);
+
+    // A syntax error leaves holes (null statements) in the tree, don't try to run it
+    if(hadError) return;
+
+    // Constants are computed once here instead of on every evaluation, then the code they make
+    // unreachable (or pointless) is dropped, what loops recompute on every iteration is kept aside, and
+    // so is what a block computes twice
+    if(optimize){
+        statements = ConstantFolder(arena).fold(statements);
+        statements = DeadCode(arena).prune(statements);
+        statements = LoopInvariants(arena).hoist(statements);
+        statements = CommonSubexpressions(arena).eliminate(statements);
+    }
+
+    // The interpreter runs on the flat, index based form of the tree
+    FlatAst program = Flattener{}.flatten(statements);
+    if(!compiled.empty()) AstCache::save(compiled, program, source, compileOptions());
+
     Interpreter eval;
-    eval.interpret(statements);
+    eval.interpret(program);
 }
 
 
 void runFile(std::string path){
-    std::string content = readFile(path);
-    run(content);
+    SourceBuffer content = readFile(path);
+
+    if(!useCache || path == "-"){
+        run(content.view());
+    }
+    else{
+        // An unchanged script runs straight from its cache, without being scanned or parsed
+        std::string compiled = cachePath(path);
+        AstCache cache;
+        if(cache.load(compiled, content.view(), compileOptions())){
+            Interpreter eval;
+            eval.interpret(cache.program());
+        }
+        else run(content.view(), compiled);
+    }
 
     if(hadError) {
         std::exit(65);
@@ -56,6 +140,96 @@ void runFile(std::string path){
 }
 
 
+// --check : scan and parse only, reporting every error in every file without running anything
+void checkFiles(const std::vector<std::string>& paths){
+    bool failed = false;
+
+    for(const std::string& path : paths){
+        // Errors are not tagged with a file, so label each file when there are several
+        if(paths.size() > 1) std::cerr<<"==> "<<path<<std::endl;
+
+        SourceBuffer content = readFile(path);
+        TokenBuffer tokens = ParallelScanner(content.view()).scanTokens();
+        Arena arena;
+        ParallelParser p(tokens, arena, maxDepth);
+        p.parse();
+        for(const Diagnostic& diagnostic : p.diagnostics) report(diagnostic);
+
+        failed = failed || hadError;
+        hadError = false;
+    }
+
+    std::exit(failed ? 65 : 0);
+}
+
+
+// --edits : keep a script parsed while an editor sends it edits on stdin, reparsing only around each one.
+// An edit is a line "offset removed length" followed by the `length` bytes inserted at `offset` in place of
+// the `removed` ones. The diagnostics of the whole text are printed on opening and after each edit : their
+// count, then one per line
+void editSession(const std::string& path){
+    SourceBuffer content = readFile(path);
+    Document document(std::string(content.view()), maxDepth);
+
+    auto print = [&](){
+        std::vector<Diagnostic> diagnostics = document.diagnostics();
+        std::cout<<diagnostics.size()<<"\n";
+        for(const Diagnostic& diagnostic : diagnostics){
+            std::cout<<"[line : "<<diagnostic.line<<"] Error"<<diagnostic.where<<" - "<<diagnostic.message<<"\n";
+        }
+        std::cout<<std::flush;
+    };
+
+    print();
+    std::size_t offset, removed, length;
+    while(std::cin>>offset>>removed>>length && std::cin.get() == '\n'){
+        std::string inserted(length, '\0');
+        if(!std::cin.read(inserted.data(), static_cast<std::streamsize>(length))) break;
+        document.edit(offset, removed, inserted);
+        print();
+    }
+
+    std::exit(0);
+}
+
+
+// --ast-stats : how much memory hash-consing saves on each file (and on all of them together)
+void astStats(const std::vector<std::string>& paths){
+    std::size_t requested = 0, allocated = 0, shared = 0, unshared = 0;
+
+    auto print = [](std::size_t requested, std::size_t allocated, std::size_t shared, std::size_t unshared){
+        std::cout<<"  expressions : "<<requested<<" parsed, "<<allocated<<" allocated ("
+                 <<(requested == 0 ? 0 : 100 * (requested - allocated) / requested)<<"% shared)\n"
+                 <<"  arena bytes : "<<unshared<<" without sharing, "<<shared<<" with ("
+                 <<(unshared == 0 ? 0 : 100 * (unshared - shared) / unshared)<<"% saved)\n";
+    };
+
+    for(const std::string& path : paths){
+        SourceBuffer content = readFile(path);
+        TokenBuffer tokens = ParallelScanner(content.view()).scanTokens();
+        Arena arena;
+        HashConsTable table;
+        Parser p(tokens, arena, maxDepth);
+        p.shareSubtrees(table);
+        p.parse();
+
+        std::cout<<"==> "<<path<<"\n";
+        print(table.requested, table.allocated, arena.bytesUsed(), arena.bytesUsed() + table.bytesSaved);
+
+        requested += table.requested;
+        allocated += table.allocated;
+        shared += arena.bytesUsed();
+        unshared += arena.bytesUsed() + table.bytesSaved;
+    }
+
+    if(paths.size() > 1){
+        std::cout<<"==> total\n";
+        print(requested, allocated, shared, unshared);
+    }
+    std::exit(0);
+}
+
+
 void runPrompt(){
     std::string source;
     while(true){
@@ -67,13 +241,52 @@ void runPrompt(){
     }
 }
 
+void usage(){
+    std::cout<<"Usage: jlox [--max-depth N] [--no-cache] [--hash-cons] [--no-optimize] [script]\n"
+             <<"       jlox [--max-depth N] --check script...\n"
+             <<"       jlox [--max-depth N] --ast-stats script...\n"
+             <<"       jlox [--max-depth N] --edits script\n";
+    std::exit(64);
+}
+
 int main(int argc, char** argv){
-    if(argc > 2){
-        std::cout<<"Usage: jlox [script]\n";
-        std::exit(64);
+    bool checkOnly = false;
+    bool statsOnly = false;
+    bool editsOnly = false;
+    std::vector<std::string> scripts;
+    for(int i = 1; i < argc; ++i){
+        std::string arg = argv[i];
+        if(arg == "--check") checkOnly = true;
+        else if(arg == "--no-cache") useCache = false;
+        else if(arg == "--hash-cons") hashCons = true;
+        else if(arg == "--no-optimize") optimize = false;
+        else if(arg == "--ast-stats") statsOnly = true;
+        else if(arg == "--edits") editsOnly = true;
+        else if(arg == "--max-depth"){
+            if(++i == argc) usage();
+            maxDepth = std::atoi(argv[i]);
+            if(maxDepth <= 0) usage();
+        }
+        else scripts.push_back(arg);
+    }
+
+    if(checkOnly){
+        if(scripts.empty()) usage();
+        checkFiles(scripts);
+    }
+    else if(statsOnly){
+        if(scripts.empty()) usage();
+        astStats(scripts);
+    }
+    else if(editsOnly){
+        if(scripts.size() != 1) usage();
+        editSession(scripts[0]);
+    }
+    else if(scripts.size() > 1){
+        usage();
     }
-    else if(argc == 2){
-        runFile(argv[1]);
+    else if(scripts.size() == 1){
+        runFile(scripts[0]);
     }
     else{
         std::cout<<"Interactive mode!"<<std::endl;
@@ -0,0 +1,262 @@
+#pragma once
+
+#include<optional>
+#include<string>
+#include<unordered_map>
+#include<variant>
+#include<vector>
+#include"../interpreter/Stmt.h"
+#include"../scanner/Expr.h"
+#include"../utils/arena.h"
+#include"../utils/interner.h"
+#include"../utils/tokenType.h"
+#include"../utils/value.h"
+#include"scopes.h"
+
+/*
+Constant folding and propagation, run on the parsed tree before it is flattened.
+
+    - Unary, Binary, Logical and Ternary nodes whose operands are literals become one literal, computed with
+      the interpreter's own semantics (value.h). An expression that would raise a runtime error (`-"a"`,
+      `1 + nil`, a ternary on a non boolean) is left as it is, so the error still happens, at its line
+    - A `var` initialized to a constant and never assigned is a constant : reads of it become the literal
+    - Groupings are dropped
+
+Nodes are immutable and may be shared (hash-consing), so nothing is changed in place : a node whose children
+changed is rebuilt in the arena, every other one is kept as is.
+*/
+
+class ConstantFolder : public ExprVisitor<ConstantFolder, const Expr*>, public StmtVisitor<ConstantFolder, const Stmt*> {
+
+public:
+    using ExprVisitor::visit;
+    using StmtVisitor::visit;
+
+    // New nodes are made in `arena`, which must be the one the tree lives in (or outlive it)
+    explicit ConstantFolder(Arena& arena) : arena(arena) {}
+
+    std::vector<const Stmt*> fold(const std::vector<const Stmt*>& statements){
+        assigned = AssignedVariables{};
+        assigned.find(statements);
+        scopes = Scopes{};
+        constants.clear();
+
+        std::vector<const Stmt*> folded;
+        folded.reserve(statements.size());
+        for(const Stmt* statement : statements) folded.push_back(fold(statement));
+        return folded;
+    }
+
+    const Stmt* visitBlockStmt(const Block* stmt) {
+        scopes.begin();
+        std::vector<const Stmt*> body;
+        body.reserve(stmt->statements.size());
+        bool changed = false;
+        for(const Stmt* statement : stmt->statements){
+            body.push_back(fold(statement));
+            changed = changed || body.back() != statement;
+        }
+        scopes.end();
+
+        return changed ? arena.make<Block>(std::move(body)) : stmt;
+    }
+
+    const Stmt* visitExpressionStmt(const Expression* stmt) {
+        const Expr* expression = fold(stmt->expression);
+        return expression == stmt->expression ? stmt : arena.make<Expression>(expression);
+    }
+
+    const Stmt* visitIfStmt(const If* stmt) {
+        const Expr* condition = fold(stmt->condition);
+        const Stmt* thenBranch = fold(stmt->thenBranch);
+        const Stmt* elseBranch = fold(stmt->elseBranch);
+        if(condition == stmt->condition && thenBranch == stmt->thenBranch && elseBranch == stmt->elseBranch) return stmt;
+        return arena.make<If>(condition, thenBranch, elseBranch);
+    }
+
+    const Stmt* visitPrintStmt(const Print* stmt) {
+        const Expr* expression = fold(stmt->expression);
+        return expression == stmt->expression ? stmt : arena.make<Print>(expression);
+    }
+
+    const Stmt* visitVarStmt(const Var* stmt) {
+        // The initializer still sees an outer variable of the same name
+        const Expr* initializer = fold(stmt->initializer);
+        scopes.declare(stmt);
+
+        if(assigned.targets.count(stmt) == 0){
+            if(initializer == nullptr) constants[stmt] = arena.make<Literal>(Value{nullptr});
+            else if(initializer->kind == ExprKind::Literal) constants[stmt] = initializer;
+        }
+
+        return initializer == stmt->initializer ? stmt : arena.make<Var>(stmt->name, initializer);
+    }
+
+    const Stmt* visitWhileStmt(const While* stmt) {
+        const Expr* condition = fold(stmt->condition);
+        const Stmt* body = fold(stmt->body);
+        if(condition == stmt->condition && body == stmt->body) return stmt;
+        return arena.make<While>(condition, body);
+    }
+
+    const Expr* visitAssignExpr(const Assign* expr) {
+        const Expr* value = fold(expr->value);
+        return value == expr->value ? expr : arena.make<Assign>(expr->name, value);
+    }
+
+    const Expr* visitBinaryExpr(const Binary* expr) {
+        return leftSpine(expr);
+    }
+
+    const Expr* visitLogicalExpr(const Logical* expr) {
+        return leftSpine(expr);
+    }
+
+    const Expr* visitUnaryExpr(const Unary* expr) {
+        const Expr* right = fold(expr->right);
+
+        if(const Value* value = literal(right)){
+            if(expr->op.type == BANG) return arena.make<Literal>(Value{!isTruthy(*value)});
+            if(expr->op.type == MINUS && std::holds_alternative<double>(*value)) return arena.make<Literal>(Value{-std::get<double>(*value)});
+        }
+
+        return right == expr->right ? expr : arena.make<Unary>(expr->op, right);
+    }
+
+    const Expr* visitLiteralExpr(const Literal* expr) {
+        return expr;
+    }
+
+    const Expr* visitGroupingExpr(const Grouping* expr) {
+        return fold(expr->expression);
+    }
+
+    const Expr* visitTernaryExpr(const Ternary* expr) {
+        const Expr* left = fold(expr->left);
+        const Expr* middle = fold(expr->middle);
+        const Expr* right = fold(expr->right);
+
+        // The interpreter only accepts a boolean condition
+        const Value* condition = literal(left);
+        if(condition != nullptr && std::holds_alternative<bool>(*condition)){
+            const Expr* chosen = std::get<bool>(*condition) ? middle : right;
+            if(literal(chosen) != nullptr) return chosen;
+        }
+
+        if(left == expr->left && middle == expr->middle && right == expr->right) return expr;
+        return arena.make<Ternary>(left, expr->leftOp, middle, expr->middleOp, right);
+    }
+
+    const Expr* visitVariableExpr(const Variable* expr) {
+        const Var* declaration = scopes.find(expr->name.symbol);
+        if(declaration != nullptr){
+            auto it = constants.find(declaration);
+            if(it != constants.end()) return it->second;
+        }
+        return expr;
+    }
+
+private:
+    Arena& arena;
+    AssignedVariables assigned;
+    Scopes scopes;
+    // Literal value of every constant declaration seen so far
+    std::unordered_map<const Var*, const Expr*> constants;
+
+    const Stmt* fold(const Stmt* stmt){
+        if(stmt == nullptr) return nullptr;
+        return visit(stmt);
+    }
+
+    const Expr* fold(const Expr* expr){
+        if(expr == nullptr) return nullptr;
+        return visit(expr);
+    }
+
+    // While the chain folds, its value is kept in `pending` instead of a new Literal per step, so
+    // "a" + "b" + "c" + ... appends to one string and allocates only the final value
+    const Expr* leftSpine(const Expr* expr){
+        std::optional<Value> pending;
+        const Expr* left = walkLeftSpine(expr, [&](const Expr* bottom){ return fold(bottom); },
+                                         [&](const Expr* node, const Expr* left){ return step(node, left, pending); });
+        return materialize(left, pending);
+    }
+
+    // One step up the spine : `node` given its folded left operand (or the pending value)
+    const Expr* step(const Expr* node, const Expr* left, std::optional<Value>& pending){
+        if(node->kind == ExprKind::Binary){
+            const Binary* binary = static_cast<const Binary*>(node);
+            const Expr* right = fold(binary->right);
+
+            if(const Value* rightValue = literal(right)){
+                if(pending && binary->op.type == PLUS && std::holds_alternative<std::string>(*pending) && isString(*rightValue)){
+                    std::get<std::string>(*pending) += asString(*rightValue);
+                    return left;
+                }
+                const Value* leftValue = pending ? &*pending : literal(left);
+                if(leftValue != nullptr){
+                    if(std::optional<Value> value = evaluate(binary->op.type, *leftValue, *rightValue)){
+                        pending = std::move(value);
+                        return left;
+                    }
+                }
+            }
+
+            left = materialize(left, pending);
+            if(left != binary->left || right != binary->right) return arena.make<Binary>(left, binary->op, right);
+            return binary;
+        }
+
+        const Logical* logical = static_cast<const Logical*>(node);
+        const Value* leftValue = pending ? &*pending : literal(left);
+
+        // The right operand never runs, the left value is the result
+        if(leftValue != nullptr && (logical->op.type == OR ? isTruthy(*leftValue) : !isTruthy(*leftValue))) return left;
+
+        const Expr* right = fold(logical->right);
+        if(leftValue != nullptr && literal(right) != nullptr){
+            pending.reset();
+            return right;
+        }
+
+        left = materialize(left, pending);
+        if(left != logical->left || right != logical->right) return arena.make<Logical>(left, logical->op, right);
+        return logical;
+    }
+
+    // The node for `left`, allocating the pending value if there is one
+    const Expr* materialize(const Expr* left, std::optional<Value>& pending){
+        if(!pending) return left;
+        const Expr* node = arena.make<Literal>(std::move(*pending));
+        pending.reset();
+        return node;
+    }
+
+    // What the interpreter computes for `left op right`, or nothing if that is a runtime error
+    // (or an operator it does not fold)
+    static std::optional<Value> evaluate(TokenType op, const Value& left, const Value& right){
+        bool numbers = std::holds_alternative<double>(left) && std::holds_alternative<double>(right);
+        double a = numbers ? std::get<double>(left) : 0;
+        double b = numbers ? std::get<double>(right) : 0;
+
+        switch(op){
+            case(PLUS): {
+                if(isString(left) && isString(right)) return Value{asString(left) + asString(right)};
+                if(numbers) return Value{a + b};
+                break;
+            }
+            case(MINUS):         if(numbers) return Value{a - b}; break;
+            case(SLASH):         if(numbers) return Value{a / b}; break;
+            case(STAR):          if(numbers) return Value{a * b}; break;
+            case(GREATER):       if(numbers) return Value{a > b}; break;
+            case(GREATER_EQUAL): if(numbers) return Value{a >= b}; break;
+            case(LESS):          if(numbers) return Value{a < b}; break;
+            case(LESS_EQUAL):    if(numbers) return Value{a <= b}; break;
+            case(EQUAL_EQUAL):   return Value{isEqual(left, right)};
+            case(BANG_EQUAL):    return Value{!isEqual(left, right)};
+            default: break;
+        }
+
+        return std::nullopt;
+    }
+};
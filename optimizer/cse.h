@@ -0,0 +1,459 @@
+#pragma once
+
+#include<array>
+#include<cstdint>
+#include<cstring>
+#include<functional>
+#include<string>
+#include<unordered_map>
+#include<unordered_set>
+#include<variant>
+#include<vector>
+#include"../interpreter/Stmt.h"
+#include"../scanner/Expr.h"
+#include"../scanner/token.h"
+#include"../utils/arena.h"
+#include"../utils/interner.h"
+#include"../utils/tokenType.h"
+#include"../utils/value.h"
+#include"scopes.h"
+
+/*
+Local common subexpression elimination : inside a basic block (statements that run one after the other,
+with no if / while / block between them), an expression computed again with the same variables
+unchanged reuses the first value through a temporary :
+
+    print (x - cx) * (x - cx);      becomes      var $c0; print ($c0 = x - cx) * $c0;
+
+Expressions are compared by value numbering : a number per distinct (operator, operand numbers) and per
+literal, and for variables per (name, version). Every assignment or declaration of a name bumps its
+version, so an expression reading it after that gets a new number and no longer matches the old value.
+
+    - Only expressions without assignments, of at least `minSize` nodes, are reused
+    - The right operand of `and` / `or` and the arms of a ternary may not run : what they compute is only
+      reused inside them, never after them
+    - The condition of an `if` is part of the block before it. The condition of a `while` runs again
+      after the body, so it is a block of its own, and so is every branch and body
+    - A reuse only ever happens after the first evaluation has run, and a pure expression of unchanged
+      variables gives the same value every time : errors are raised exactly where they used to be
+
+Each block is walked twice : once to count which values are reused, then to rewrite (with the same
+numbering) the first evaluation of those into an assignment to a temporary, and the later ones into reads
+of it. A temporary is always filled before it is read in its own block and never used outside of it, so
+they are all declared once, as globals at the start of the program (a declaration in a loop body would run
+on every iteration).
+*/
+class CommonSubexpressions {
+
+public:
+    static constexpr std::uint32_t minSize = 3;
+
+    explicit CommonSubexpressions(Arena& arena) : arena(arena) {}
+
+    std::vector<const Stmt*> eliminate(const std::vector<const Stmt*>& statements){
+        declared.clear();
+        bool changed = false;
+        std::vector<const Stmt*> body = list(statements, changed);
+        if(declared.empty()) return body;
+
+        std::vector<const Stmt*> program;
+        program.reserve(declared.size() + body.size());
+        for(const Token& name : declared) program.push_back(arena.make<Var>(name, nullptr));
+        program.insert(program.end(), body.begin(), body.end());
+        return program;
+    }
+
+private:
+    struct Number {
+        bool pure;           // no assignment in it
+        std::uint32_t value; // value number, when pure
+        std::uint32_t size;  // nodes
+    };
+
+    struct Key {
+        ExprKind kind = ExprKind::Literal;
+        TokenType op = NIL;
+        std::uint8_t valueType = 0;  // variant index of a literal
+        std::uint64_t value = 0;     // literal bits, or the name's Symbol
+        std::uint32_t version = 0;   // of a variable
+        std::uint32_t children[3] = {0, 0, 0};
+
+        bool operator==(const Key& other) const {
+            return kind == other.kind && op == other.op && valueType == other.valueType && value == other.value
+                && version == other.version && children[0] == other.children[0] && children[1] == other.children[1]
+                && children[2] == other.children[2];
+        }
+    };
+
+    struct KeyHash {
+        std::size_t operator()(const Key& key) const {
+            std::size_t hash = static_cast<std::size_t>(key.kind) * 31 + key.op;
+            auto mix = [&](std::size_t part){ hash ^= part + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2); };
+            mix(key.valueType);
+            mix(std::hash<std::uint64_t>{}(key.value));
+            mix(key.version);
+            for(std::uint32_t child : key.children) mix(child);
+            return hash;
+        }
+    };
+
+    struct Memo {
+        Number number;
+        std::uint32_t epoch;
+    };
+
+    Arena& arena;
+    std::vector<Token> declared;  // every temporary made so far
+
+    // State of the basic block being walked, reset before each of its two passes
+    bool rewriting = false;
+    std::unordered_map<Key, std::uint32_t, KeyHash> numbers;
+    std::uint32_t values = 0;                              // value numbers handed out
+    std::unordered_map<Symbol, std::uint32_t> versions;
+    std::unordered_map<const Expr*, Memo> memo;            // numbers of nodes, valid while epoch is unchanged
+    std::uint32_t epoch = 0;                               // bumped with every version
+    std::unordered_set<std::uint32_t> available;           // values computed so far
+    std::vector<std::uint32_t> added;                      // ... in order, so a branch can drop its own
+    std::unordered_map<std::uint32_t, std::uint32_t> uses; // first pass : how often each value is reused
+    std::unordered_map<std::uint32_t, Token> temporaries;  // second pass : the temporary of each reused value
+
+    // Statements that can be part of a basic block
+    static bool straight(const Stmt* stmt){
+        return stmt->kind == StmtKind::Expression || stmt->kind == StmtKind::Print || stmt->kind == StmtKind::Var;
+    }
+
+    // The one expression a statement evaluates before anything else (nullptr for blocks and uninitialized vars)
+    static const Expr* expressionOf(const Stmt* stmt){
+        switch(stmt->kind){
+            case StmtKind::Expression: return static_cast<const Expression*>(stmt)->expression;
+            case StmtKind::Print:      return static_cast<const Print*>(stmt)->expression;
+            case StmtKind::Var:        return static_cast<const Var*>(stmt)->initializer;
+            case StmtKind::If:         return static_cast<const If*>(stmt)->condition;
+            case StmtKind::While:      return static_cast<const While*>(stmt)->condition;
+            default:                   return nullptr;
+        }
+    }
+
+    // Cut a list of statements into basic blocks
+    std::vector<const Stmt*> list(const std::vector<const Stmt*>& statements, bool& changed){
+        std::vector<const Stmt*> out;
+        out.reserve(statements.size());
+
+        std::size_t i = 0;
+        while(i < statements.size()){
+            std::size_t last = i;
+            while(last < statements.size() && straight(statements[last])) ++last;
+            if(last < statements.size() && statements[last]->kind == StmtKind::If) ++last;
+            else if(last == i && statements[i]->kind == StmtKind::While) ++last;
+
+            if(last == i){
+                const Stmt* stmt = branch(statements[i]);
+                changed = changed || stmt != statements[i];
+                out.push_back(stmt);
+                ++i;
+                continue;
+            }
+
+            basicBlock(statements, i, last, out, changed);
+            i = last;
+        }
+
+        return out;
+    }
+
+    // A branch or a loop body : a list of its own
+    const Stmt* branch(const Stmt* stmt){
+        if(stmt == nullptr) return nullptr;
+
+        bool changed = false;
+        if(stmt->kind == StmtKind::Block){
+            const Block* block = static_cast<const Block*>(stmt);
+            std::vector<const Stmt*> body = list(block->statements, changed);
+            return changed ? arena.make<Block>(std::move(body)) : stmt;
+        }
+        return list({stmt}, changed)[0];
+    }
+
+    void basicBlock(const std::vector<const Stmt*>& statements, std::size_t first, std::size_t last,
+                    std::vector<const Stmt*>& out, bool& changed){
+        start(false);
+        for(std::size_t i = first; i < last; ++i) statement(statements[i]);
+
+        std::vector<const Expr*> rewritten(last - first);
+        if(!uses.empty()){
+            start(true);
+            for(std::size_t i = first; i < last; ++i) rewritten[i - first] = statement(statements[i]);
+        }
+        else{
+            for(std::size_t i = first; i < last; ++i) rewritten[i - first] = expressionOf(statements[i]);
+        }
+
+        for(std::size_t i = first; i < last; ++i){
+            const Stmt* stmt = statements[i];
+            const Expr* expression = rewritten[i - first];
+            const Stmt* result = stmt;
+            switch(stmt->kind){
+                case StmtKind::Expression: {
+                    if(expression != expressionOf(stmt)) result = arena.make<Expression>(expression);
+                    break;
+                }
+                case StmtKind::Print: {
+                    if(expression != expressionOf(stmt)) result = arena.make<Print>(expression);
+                    break;
+                }
+                case StmtKind::Var: {
+                    if(expression != expressionOf(stmt)) result = arena.make<Var>(static_cast<const Var*>(stmt)->name, expression);
+                    break;
+                }
+                case StmtKind::If: {
+                    const If* ifStmt = static_cast<const If*>(stmt);
+                    const Stmt* thenBranch = branch(ifStmt->thenBranch);
+                    const Stmt* elseBranch = branch(ifStmt->elseBranch);
+                    if(expression != ifStmt->condition || thenBranch != ifStmt->thenBranch || elseBranch != ifStmt->elseBranch){
+                        result = arena.make<If>(expression, thenBranch, elseBranch);
+                    }
+                    break;
+                }
+                case StmtKind::While: {
+                    const While* whileStmt = static_cast<const While*>(stmt);
+                    const Stmt* body = branch(whileStmt->body);
+                    if(expression != whileStmt->condition || body != whileStmt->body) result = arena.make<While>(expression, body);
+                    break;
+                }
+                default: break;
+            }
+
+            changed = changed || result != stmt;
+            out.push_back(result);
+        }
+    }
+
+    void start(bool rewrite){
+        rewriting = rewrite;
+        numbers.clear();
+        values = 0;
+        versions.clear();
+        memo.clear();
+        epoch = 0;
+        available.clear();
+        added.clear();
+        temporaries.clear();
+        if(!rewrite) uses.clear();
+    }
+
+    const Expr* statement(const Stmt* stmt){
+        const Expr* expression = expressionOf(stmt);
+        if(expression != nullptr) expression = walk(expression);
+        if(stmt->kind == StmtKind::Var) bump(static_cast<const Var*>(stmt)->name.symbol);
+        return expression;
+    }
+
+    // A new binding or value for `name` : every number computed so far may be stale
+    void bump(Symbol name){
+        ++versions[name];
+        ++epoch;
+    }
+
+    // Code that may not run : values it computes are forgotten after it
+    std::size_t enter() const {
+        return added.size();
+    }
+
+    void leave(std::size_t mark){
+        while(added.size() > mark){
+            available.erase(added.back());
+            added.pop_back();
+        }
+    }
+
+    bool reusable(const Number& number) const {
+        return number.pure && number.size >= minSize && available.count(number.value) != 0;
+    }
+
+    // Walk an expression in evaluation order, returning what to use in its place. The spine stops at a
+    // value that is available already : node() replaces it whole
+    const Expr* walk(const Expr* expr){
+        std::vector<Number> spine;  // numbers of the spine nodes, innermost last
+        auto descend = [&](const Expr* expr){
+            Number number = this->number(expr);
+            if(reusable(number)) return false;
+            spine.push_back(number);
+            return true;
+        };
+
+        return walkLeftSpine(expr, descend, [&](const Expr* bottom){ return node(bottom); }, [&](const Expr* expr, const Expr* left){
+            const Expr* rebuilt;
+            if(expr->kind == ExprKind::Binary){
+                const Binary* binary = static_cast<const Binary*>(expr);
+                const Expr* right = walk(binary->right);
+                rebuilt = left == binary->left && right == binary->right ? binary : arena.make<Binary>(left, binary->op, right);
+            }
+            else{
+                const Logical* logical = static_cast<const Logical*>(expr);
+                std::size_t mark = enter();
+                const Expr* right = walk(logical->right);
+                leave(mark);
+                rebuilt = left == logical->left && right == logical->right ? logical : arena.make<Logical>(left, logical->op, right);
+            }
+
+            Number number = spine.back();
+            spine.pop_back();
+            return computed(number, rebuilt);
+        });
+    }
+
+    // Everything but the Binary / Logical nodes walk() is walking down
+    const Expr* node(const Expr* expr){
+        Number number = this->number(expr);
+        if(reusable(number)){
+            if(!rewriting){
+                ++uses[number.value];
+                return expr;
+            }
+            return arena.make<Variable>(temporary(number.value));
+        }
+
+        const Expr* rebuilt = expr;
+        switch(expr->kind){
+            case ExprKind::Grouping: return walk(static_cast<const Grouping*>(expr)->expression);
+
+            case ExprKind::Assign: {
+                const Assign* assign = static_cast<const Assign*>(expr);
+                const Expr* value = walk(assign->value);
+                bump(assign->name.symbol);
+                if(value != assign->value) rebuilt = arena.make<Assign>(assign->name, value);
+                break;
+            }
+
+            case ExprKind::Unary: {
+                const Unary* unary = static_cast<const Unary*>(expr);
+                const Expr* right = walk(unary->right);
+                if(right != unary->right) rebuilt = arena.make<Unary>(unary->op, right);
+                break;
+            }
+
+            case ExprKind::Ternary: {
+                const Ternary* ternary = static_cast<const Ternary*>(expr);
+                const Expr* left = walk(ternary->left);
+                std::size_t mark = enter();
+                const Expr* middle = walk(ternary->middle);
+                leave(mark);
+                const Expr* right = walk(ternary->right);
+                leave(mark);
+                if(left != ternary->left || middle != ternary->middle || right != ternary->right){
+                    rebuilt = arena.make<Ternary>(left, ternary->leftOp, middle, ternary->middleOp, right);
+                }
+                break;
+            }
+
+            case ExprKind::Binary:
+            case ExprKind::Logical: return walk(expr);
+
+            default: break;  // literals and variables
+        }
+
+        return computed(number, rebuilt);
+    }
+
+    // `expr` (rebuilt) has just been evaluated : its value is available from now on, and goes to its
+    // temporary if it is reused later
+    const Expr* computed(const Number& number, const Expr* expr){
+        if(!number.pure || number.size < minSize) return expr;
+
+        available.insert(number.value);
+        added.push_back(number.value);
+        if(rewriting && uses.count(number.value) != 0) return arena.make<Assign>(temporary(number.value), expr);
+        return expr;
+    }
+
+    const Token& temporary(std::uint32_t value){
+        auto it = temporaries.find(value);
+        if(it == temporaries.end()){
+            Symbol symbol = intern("$c" + std::to_string(declared.size()));
+            it = temporaries.emplace(value, Token(IDENTIFIER, symbol.str(), nullptr, 0, symbol)).first;
+            declared.push_back(it->second);
+        }
+        return it->second;
+    }
+
+    bool fresh(const Expr* expr) const {
+        auto it = memo.find(expr);
+        return it != memo.end() && it->second.epoch == epoch;
+    }
+
+    // Number of `root` under the current versions, numbering its subtree children first with an explicit stack
+    Number number(const Expr* root){
+        auto it = memo.find(root);
+        if(it != memo.end() && it->second.epoch == epoch) return it->second.number;
+
+        Number number{};
+        std::vector<std::pair<const Expr*, bool>> stack{{root, false}};
+        while(!stack.empty()){
+            auto [expr, expanded] = stack.back();
+            // Shared (hash-consed) nodes are numbered once
+            if(expr != root && fresh(expr)){
+                stack.pop_back();
+                continue;
+            }
+            if(!expanded){
+                stack.back().second = true;
+                for(const Expr* child : children(expr)){
+                    if(child != nullptr && !fresh(child)) stack.push_back({child, false});
+                }
+                continue;
+            }
+            stack.pop_back();
+            number = compute(expr);
+            memo[expr] = Memo{number, epoch};
+        }
+        return number;
+    }
+
+    // Number of a node whose children are numbered
+    Number compute(const Expr* expr){
+        Key key;
+        key.kind = expr->kind;
+        Number number{true, 0, 1};
+
+        std::array<const Expr*, 3> operands = children(expr);
+        for(int i = 0; i < 3; ++i){
+            if(operands[i] == nullptr) continue;
+            const Number& child = memo.find(operands[i])->second.number;
+            number.pure = number.pure && child.pure;
+            number.size += child.size;
+            key.children[i] = child.value;
+        }
+
+        switch(expr->kind){
+            case ExprKind::Literal: {
+                const Value& value = static_cast<const Literal*>(expr)->value;
+                key.valueType = static_cast<std::uint8_t>(value.index());
+                if(std::holds_alternative<bool>(value)) key.value = std::get<bool>(value);
+                else if(std::holds_alternative<double>(value)) std::memcpy(&key.value, &std::get<double>(value), sizeof(double));
+                else if(std::holds_alternative<Symbol>(value)) key.value = reinterpret_cast<std::uintptr_t>(std::get<Symbol>(value).text);
+                else if(std::holds_alternative<std::string>(value)) return Number{true, values++, 1};  // computed strings are not compared
+                break;
+            }
+            case ExprKind::Variable: {
+                Symbol name = static_cast<const Variable*>(expr)->name.symbol;
+                key.value = reinterpret_cast<std::uintptr_t>(name.text);
+                auto it = versions.find(name);
+                key.version = it == versions.end() ? 0 : it->second;
+                break;
+            }
+            // The parentheses don't change the value
+            case ExprKind::Grouping: return memo.find(static_cast<const Grouping*>(expr)->expression)->second.number;
+            case ExprKind::Assign: number.pure = false; break;
+            case ExprKind::Unary: key.op = static_cast<const Unary*>(expr)->op.type; break;
+            case ExprKind::Binary: key.op = static_cast<const Binary*>(expr)->op.type; break;
+            case ExprKind::Logical: key.op = static_cast<const Logical*>(expr)->op.type; break;
+            default: break;
+        }
+
+        if(!number.pure) return number;
+        auto inserted = numbers.try_emplace(key, values);
+        if(inserted.second) ++values;
+        number.value = inserted.first->second;
+        return number;
+    }
+};
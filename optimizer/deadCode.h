@@ -0,0 +1,242 @@
+#pragma once
+
+#include<variant>
+#include<vector>
+#include"../interpreter/Stmt.h"
+#include"../scanner/Expr.h"
+#include"../utils/arena.h"
+#include"../utils/tokenType.h"
+#include"../utils/value.h"
+#include"scopes.h"
+
+/*
+Removes code that can't run or can't matter, after the ConstantFolder has turned known conditions into literals.
+
+    - `if` on a literal keeps only the branch taken, `while` on a falsy literal goes away, and nothing
+      after a `while` on a truthy literal can run (there is no break : only a runtime error leaves it)
+    - `false or x` / `true and x` are just `x`, a ternary on a literal boolean is just the arm it picks
+    - an expression statement goes away when evaluating it can neither change anything nor fail : literals,
+      variables declared before (a global read earlier is an "Undefined variable" error), `!`, `==`, `!=`,
+      `and` / `or` and `,` on such operands
+    - an `if` left with no branches keeps only its condition, if that can fail
+    - blocks that declare nothing are spliced into the enclosing list (one frame less to push), empty
+      ones go away
+
+Like the ConstantFolder, changed nodes are rebuilt in the arena and untouched ones kept.
+*/
+class DeadCode : public ExprVisitor<DeadCode, const Expr*>, public StmtVisitor<DeadCode, const Stmt*> {
+
+public:
+    using ExprVisitor::visit;
+    using StmtVisitor::visit;
+
+    explicit DeadCode(Arena& arena) : arena(arena) {}
+
+    std::vector<const Stmt*> prune(const std::vector<const Stmt*>& statements){
+        scopes = Scopes{};
+        bool changed = false;
+        return list(statements, changed);
+    }
+
+    // Statements return nullptr when nothing of them is left to run
+
+    const Stmt* visitBlockStmt(const Block* stmt) {
+        scopes.begin();
+        bool changed = false;
+        std::vector<const Stmt*> body = list(stmt->statements, changed);
+        scopes.end();
+
+        if(body.empty()) return nullptr;
+        return changed ? arena.make<Block>(std::move(body)) : stmt;
+    }
+
+    const Stmt* visitExpressionStmt(const Expression* stmt) {
+        const Expr* expression = prune(stmt->expression);
+        if(pure(expression)) return nullptr;
+        return expression == stmt->expression ? stmt : arena.make<Expression>(expression);
+    }
+
+    const Stmt* visitIfStmt(const If* stmt) {
+        const Expr* condition = prune(stmt->condition);
+        if(const Value* value = literal(condition)){
+            const Stmt* taken = isTruthy(*value) ? stmt->thenBranch : stmt->elseBranch;
+            return prune(taken);
+        }
+
+        const Stmt* thenBranch = prune(stmt->thenBranch);
+        const Stmt* elseBranch = prune(stmt->elseBranch);
+        if(thenBranch == nullptr && elseBranch == nullptr){
+            return pure(condition) ? nullptr : arena.make<Expression>(condition);
+        }
+        if(thenBranch == nullptr) thenBranch = empty();
+
+        if(condition == stmt->condition && thenBranch == stmt->thenBranch && elseBranch == stmt->elseBranch) return stmt;
+        return arena.make<If>(condition, thenBranch, elseBranch);
+    }
+
+    const Stmt* visitPrintStmt(const Print* stmt) {
+        const Expr* expression = prune(stmt->expression);
+        return expression == stmt->expression ? stmt : arena.make<Print>(expression);
+    }
+
+    const Stmt* visitVarStmt(const Var* stmt) {
+        const Expr* initializer = prune(stmt->initializer);
+        scopes.declare(stmt);
+        return initializer == stmt->initializer ? stmt : arena.make<Var>(stmt->name, initializer);
+    }
+
+    const Stmt* visitWhileStmt(const While* stmt) {
+        const Expr* condition = prune(stmt->condition);
+        const Value* value = literal(condition);
+        if(value != nullptr && !isTruthy(*value)) return nullptr;
+
+        const Stmt* body = prune(stmt->body);
+        if(body == nullptr) body = empty();
+
+        if(condition == stmt->condition && body == stmt->body) return stmt;
+        return arena.make<While>(condition, body);
+    }
+
+    const Expr* visitAssignExpr(const Assign* expr) {
+        const Expr* value = prune(expr->value);
+        return value == expr->value ? expr : arena.make<Assign>(expr->name, value);
+    }
+
+    const Expr* visitBinaryExpr(const Binary* expr) {
+        return leftSpine(expr);
+    }
+
+    const Expr* visitLogicalExpr(const Logical* expr) {
+        return leftSpine(expr);
+    }
+
+    const Expr* visitUnaryExpr(const Unary* expr) {
+        const Expr* right = prune(expr->right);
+        return right == expr->right ? expr : arena.make<Unary>(expr->op, right);
+    }
+
+    const Expr* visitLiteralExpr(const Literal* expr) {
+        return expr;
+    }
+
+    const Expr* visitGroupingExpr(const Grouping* expr) {
+        return prune(expr->expression);
+    }
+
+    const Expr* visitTernaryExpr(const Ternary* expr) {
+        const Expr* left = prune(expr->left);
+
+        // The interpreter only accepts a boolean condition
+        const Value* condition = literal(left);
+        if(condition != nullptr && std::holds_alternative<bool>(*condition)){
+            return prune(std::get<bool>(*condition) ? expr->middle : expr->right);
+        }
+
+        const Expr* middle = prune(expr->middle);
+        const Expr* right = prune(expr->right);
+        if(left == expr->left && middle == expr->middle && right == expr->right) return expr;
+        return arena.make<Ternary>(left, expr->leftOp, middle, expr->middleOp, right);
+    }
+
+    const Expr* visitVariableExpr(const Variable* expr) {
+        return expr;
+    }
+
+private:
+    Arena& arena;
+    Scopes scopes;
+
+    const Stmt* prune(const Stmt* stmt){
+        if(stmt == nullptr) return nullptr;
+        return visit(stmt);
+    }
+
+    const Expr* prune(const Expr* expr){
+        if(expr == nullptr) return nullptr;
+        return visit(expr);
+    }
+
+    // A statement that does nothing, where one is required (the body of a loop, the then branch of an if with an else)
+    const Stmt* empty(){
+        return arena.make<Block>(std::vector<const Stmt*>{});
+    }
+
+    // Prune a list of statements, dropping what is gone and splicing in blocks that declare nothing
+    std::vector<const Stmt*> list(const std::vector<const Stmt*>& statements, bool& changed){
+        std::vector<const Stmt*> pruned;
+        pruned.reserve(statements.size());
+
+        for(std::size_t i = 0; i < statements.size(); ++i){
+            const Stmt* stmt = prune(statements[i]);
+            changed = changed || stmt != statements[i];
+            if(stmt == nullptr) continue;
+
+            if(stmt->kind == StmtKind::Block && !declares(static_cast<const Block*>(stmt))){
+                const std::vector<const Stmt*>& body = static_cast<const Block*>(stmt)->statements;
+                pruned.insert(pruned.end(), body.begin(), body.end());
+                changed = true;
+            }
+            else pruned.push_back(stmt);
+
+            if(loopsForever(stmt)){
+                changed = changed || i + 1 < statements.size();
+                break;
+            }
+        }
+
+        return pruned;
+    }
+
+    static bool declares(const Block* block){
+        for(const Stmt* stmt : block->statements){
+            if(stmt->kind == StmtKind::Var) return true;
+        }
+        return false;
+    }
+
+    static bool loopsForever(const Stmt* stmt){
+        if(stmt->kind != StmtKind::While) return false;
+        const Value* condition = literal(static_cast<const While*>(stmt)->condition);
+        return condition != nullptr && isTruthy(*condition);
+    }
+
+    // Whether evaluating `root` can neither have an effect nor raise an error
+    bool pure(const Expr* root) const {
+        return everyNode(root, [&](const Expr* expr){
+            switch(expr->kind){
+                case ExprKind::Literal:
+                case ExprKind::Grouping:
+                case ExprKind::Logical:  return true;
+                case ExprKind::Variable: return scopes.find(static_cast<const Variable*>(expr)->name.symbol) != nullptr;
+                case ExprKind::Unary:    return static_cast<const Unary*>(expr)->op.type == BANG;
+                case ExprKind::Binary: {
+                    TokenType op = static_cast<const Binary*>(expr)->op.type;
+                    return op == EQUAL_EQUAL || op == BANG_EQUAL || op == COMMA;
+                }
+                default: return false;  // assignments, and ternaries (a non boolean condition is an error)
+            }
+        });
+    }
+
+    const Expr* leftSpine(const Expr* expr){
+        return walkLeftSpine(expr, [&](const Expr* bottom){ return prune(bottom); }, [&](const Expr* node, const Expr* left) -> const Expr* {
+            if(node->kind == ExprKind::Binary){
+                const Binary* binary = static_cast<const Binary*>(node);
+                const Expr* right = prune(binary->right);
+                if(left != binary->left || right != binary->right) return arena.make<Binary>(left, binary->op, right);
+                return binary;
+            }
+
+            const Logical* logical = static_cast<const Logical*>(node);
+            if(const Value* value = literal(left)){
+                // Short circuits : the right operand never runs. Otherwise it is the result
+                bool shortCircuit = logical->op.type == OR ? isTruthy(*value) : !isTruthy(*value);
+                return shortCircuit ? left : prune(logical->right);
+            }
+
+            const Expr* right = prune(logical->right);
+            if(left != logical->left || right != logical->right) return arena.make<Logical>(left, logical->op, right);
+            return logical;
+        });
+    }
+};
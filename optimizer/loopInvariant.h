@@ -0,0 +1,298 @@
+#pragma once
+
+#include<algorithm>
+#include<array>
+#include<string>
+#include<unordered_map>
+#include<unordered_set>
+#include<vector>
+#include"../interpreter/Stmt.h"
+#include"../scanner/Expr.h"
+#include"../scanner/token.h"
+#include"../utils/arena.h"
+#include"../utils/interner.h"
+#include"../utils/tokenType.h"
+#include"scopes.h"
+
+/*
+Loop invariant code motion : a `while` evaluates its condition and body again on every iteration, even
+the parts that come out the same every time (`for` loops are desugared into a `while`, so they get it too).
+
+An expression is invariant in a loop when it has no effect of its own and reads only variables the loop
+never writes. Lox has no references, closures or objects, so nothing aliases a variable : the only way to
+change one is an assignment or a declaration naming it. The writes of a loop are therefore just the names
+assigned or declared anywhere in its condition and body.
+
+The expression can't simply be computed before the loop : the loop may run zero times, the expression
+may sit in a branch that is never taken, and `a * b` fails on strings. Its temporary is filled lazily,
+where the expression was :
+
+    while (i < n * m) ...      becomes      { var $t0; while (i < ($t0 or ($t0 = n * m))) ... }
+
+The first evaluation computes it (raising any error at its own line, exactly when it always did), later
+ones read $t0. `$` can't start an identifier, so the temporaries never clash with the script's names.
+A nil or false result could not be kept that way (every read would compute it again, on top of the test),
+so only operators whose value is always a number or a string are hoisted : arithmetic and unary `-`.
+Comparisons, `!`, `and` / `or`, `,` and ternaries stay in the loop, with their invariant operands hoisted.
+
+Each expression is hoisted out of the outermost loop it is invariant in : its temporary is declared just
+before that loop, so it is reset whenever the loop is entered again. The lazy read costs two nodes, so
+only expressions of at least `minSize` nodes are hoisted.
+*/
+class LoopInvariants : public StmtVisitor<LoopInvariants, const Stmt*> {
+
+public:
+    static constexpr std::size_t minSize = 3;
+
+    explicit LoopInvariants(Arena& arena) : arena(arena) {}
+
+    std::vector<const Stmt*> hoist(const std::vector<const Stmt*>& statements){
+        loops.clear();
+        next = 0;
+
+        std::vector<const Stmt*> hoisted;
+        hoisted.reserve(statements.size());
+        for(const Stmt* statement : statements) hoisted.push_back(rewrite(statement));
+        return hoisted;
+    }
+
+    const Stmt* visitBlockStmt(const Block* stmt) {
+        std::vector<const Stmt*> body;
+        body.reserve(stmt->statements.size());
+        bool changed = false;
+        for(const Stmt* statement : stmt->statements){
+            body.push_back(rewrite(statement));
+            changed = changed || body.back() != statement;
+        }
+        return changed ? arena.make<Block>(std::move(body)) : stmt;
+    }
+
+    const Stmt* visitExpressionStmt(const Expression* stmt) {
+        const Expr* expression = root(stmt->expression);
+        return expression == stmt->expression ? stmt : arena.make<Expression>(expression);
+    }
+
+    const Stmt* visitIfStmt(const If* stmt) {
+        const Expr* condition = root(stmt->condition);
+        const Stmt* thenBranch = rewrite(stmt->thenBranch);
+        const Stmt* elseBranch = rewrite(stmt->elseBranch);
+        if(condition == stmt->condition && thenBranch == stmt->thenBranch && elseBranch == stmt->elseBranch) return stmt;
+        return arena.make<If>(condition, thenBranch, elseBranch);
+    }
+
+    const Stmt* visitPrintStmt(const Print* stmt) {
+        const Expr* expression = root(stmt->expression);
+        return expression == stmt->expression ? stmt : arena.make<Print>(expression);
+    }
+
+    const Stmt* visitVarStmt(const Var* stmt) {
+        const Expr* initializer = root(stmt->initializer);
+        return initializer == stmt->initializer ? stmt : arena.make<Var>(stmt->name, initializer);
+    }
+
+    const Stmt* visitWhileStmt(const While* stmt) {
+        Loop loop;
+        Writes writes{loop.writes};
+        writes.walk(stmt);
+        loops.push_back(std::move(loop));
+
+        // The condition runs on every iteration too
+        const Expr* condition = root(stmt->condition);
+        const Stmt* body = rewrite(stmt->body);
+
+        std::vector<Token> temporaries = std::move(loops.back().temporaries);
+        loops.pop_back();
+
+        const Stmt* rewritten = condition == stmt->condition && body == stmt->body ? stmt : arena.make<While>(condition, body);
+        if(temporaries.empty()) return rewritten;
+
+        std::vector<const Stmt*> block;
+        block.reserve(temporaries.size() + 1);
+        for(const Token& name : temporaries) block.push_back(arena.make<Var>(name, nullptr));
+        block.push_back(rewritten);
+        return arena.make<Block>(std::move(block));
+    }
+
+private:
+    struct Loop {
+        std::unordered_set<Symbol> writes;
+        std::vector<Token> temporaries;                          // declared before the loop
+        std::unordered_map<const Expr*, std::size_t> hoisted;    // expression -> its temporary
+    };
+
+    // An expression after rewriting, with the outermost loop it is invariant in (loops.size() if it
+    // varies in the innermost one) and its number of nodes
+    struct Rewritten {
+        const Expr* expr;
+        std::size_t level;
+        std::size_t size;
+    };
+
+    // Every name a loop assigns or declares
+    struct Writes : StmtVisitor<Writes, void> {
+        std::unordered_set<Symbol>& names;
+
+        explicit Writes(std::unordered_set<Symbol>& names) : names(names) {}
+
+        void walk(const Stmt* stmt){
+            if(stmt != nullptr) visit(stmt);
+        }
+
+        void visitBlockStmt(const Block* stmt) {
+            for(const Stmt* statement : stmt->statements) walk(statement);
+        }
+
+        void visitExpressionStmt(const Expression* stmt) {
+            walk(stmt->expression);
+        }
+
+        void visitIfStmt(const If* stmt) {
+            walk(stmt->condition);
+            walk(stmt->thenBranch);
+            walk(stmt->elseBranch);
+        }
+
+        void visitPrintStmt(const Print* stmt) {
+            walk(stmt->expression);
+        }
+
+        void visitVarStmt(const Var* stmt) {
+            names.insert(stmt->name.symbol);
+            walk(stmt->initializer);
+        }
+
+        void visitWhileStmt(const While* stmt) {
+            walk(stmt->condition);
+            walk(stmt->body);
+        }
+
+        void walk(const Expr* root){
+            everyNode(root, [&](const Expr* expr){
+                if(expr->kind == ExprKind::Assign) names.insert(static_cast<const Assign*>(expr)->name.symbol);
+                return true;
+            });
+        }
+    };
+
+    Arena& arena;
+    // Loops around the statement being rewritten, outermost first
+    std::vector<Loop> loops;
+    std::size_t next = 0;  // number of the next temporary
+
+    const Stmt* rewrite(const Stmt* stmt){
+        if(stmt == nullptr) return nullptr;
+        return visit(stmt);
+    }
+
+    // An expression a statement evaluates : the statement runs on every iteration of the innermost loop
+    const Expr* root(const Expr* expr){
+        if(expr == nullptr || loops.empty()) return expr;
+        return place(rewrite(expr), loops.size());
+    }
+
+    // What a parent invariant from loop `level` on uses for its child : the child itself, or the child's
+    // temporary when the child is invariant in a loop further out
+    const Expr* place(const Rewritten& child, std::size_t level){
+        if(child.level >= level || child.size < minSize || !cacheable(child.expr)) return child.expr;
+        return temporary(child.expr, child.level);
+    }
+
+    // Whether the value of `expr` is never nil or false, so that its temporary holds it once computed
+    static bool cacheable(const Expr* expr){
+        switch(expr->kind){
+            case ExprKind::Unary: return static_cast<const Unary*>(expr)->op.type == MINUS;
+            case ExprKind::Binary: {
+                TokenType op = static_cast<const Binary*>(expr)->op.type;
+                return op == PLUS || op == MINUS || op == STAR || op == SLASH;
+            }
+            default: return false;
+        }
+    }
+
+    // The level a node places its operands at : its own if it can be hoisted with them, otherwise the
+    // innermost loop's, so that what is invariant in them is hoisted on its own
+    std::size_t operandLevel(const Expr* node, std::size_t level) const {
+        return cacheable(node) ? level : loops.size();
+    }
+
+    // `$tN or ($tN = expr)`, with $tN declared before loops[level]
+    const Expr* temporary(const Expr* expr, std::size_t level){
+        Loop& loop = loops[level];
+
+        // Shared (hash-consed) nodes share their temporary
+        auto it = loop.hoisted.find(expr);
+        if(it == loop.hoisted.end()){
+            Symbol symbol = intern("$t" + std::to_string(next++));
+            loop.temporaries.push_back(Token(IDENTIFIER, symbol.str(), nullptr, 0, symbol));
+            it = loop.hoisted.emplace(expr, loop.temporaries.size() - 1).first;
+        }
+
+        const Token& name = loop.temporaries[it->second];
+        return arena.make<Logical>(arena.make<Variable>(name), Token(OR, "or", nullptr, name.line), arena.make<Assign>(name, expr));
+    }
+
+    // Outermost loop none of the loops from it inwards writes `name` in (the writes of a loop include
+    // those of every loop inside it)
+    std::size_t level(Symbol name) const {
+        std::size_t level = loops.size();
+        while(level > 0 && loops[level - 1].writes.count(name) == 0) --level;
+        return level;
+    }
+
+    Rewritten rewrite(const Expr* expr){
+        switch(expr->kind){
+            case ExprKind::Literal: return {expr, 0, 1};
+
+            case ExprKind::Variable: return {expr, level(static_cast<const Variable*>(expr)->name.symbol), 1};
+
+            case ExprKind::Grouping: return rewrite(static_cast<const Grouping*>(expr)->expression);
+
+            case ExprKind::Assign: {
+                const Assign* assign = static_cast<const Assign*>(expr);
+                Rewritten value = rewrite(assign->value);
+                const Expr* placed = place(value, loops.size());
+                return {placed == assign->value ? assign : arena.make<Assign>(assign->name, placed), loops.size(), value.size + 1};
+            }
+
+            case ExprKind::Unary: {
+                const Unary* unary = static_cast<const Unary*>(expr);
+                Rewritten right = rewrite(unary->right);
+                const Expr* r = place(right, operandLevel(unary, right.level));
+                return {r == unary->right ? unary : arena.make<Unary>(unary->op, r), right.level, right.size + 1};
+            }
+
+            case ExprKind::Ternary: {
+                const Ternary* ternary = static_cast<const Ternary*>(expr);
+                Rewritten left = rewrite(ternary->left);
+                Rewritten middle = rewrite(ternary->middle);
+                Rewritten right = rewrite(ternary->right);
+                std::size_t level = std::max({left.level, middle.level, right.level});
+
+                const Expr* l = place(left, operandLevel(ternary, level));
+                const Expr* m = place(middle, operandLevel(ternary, level));
+                const Expr* r = place(right, operandLevel(ternary, level));
+                const Expr* node = l == ternary->left && m == ternary->middle && r == ternary->right
+                    ? ternary : arena.make<Ternary>(l, ternary->leftOp, m, ternary->middleOp, r);
+                return {node, level, left.size + middle.size + right.size + 1};
+            }
+
+            default: return leftSpine(expr);
+        }
+    }
+
+    Rewritten leftSpine(const Expr* expr){
+        return walkLeftSpine(expr, [&](const Expr* bottom){ return rewrite(bottom); }, [&](const Expr* node, const Rewritten& left){
+            std::array<const Expr*, 3> operands = children(node);
+            Rewritten right = rewrite(operands[1]);
+            std::size_t level = std::max(left.level, right.level);
+            const Expr* l = place(left, operandLevel(node, level));
+            const Expr* r = place(right, operandLevel(node, level));
+
+            if(l != operands[0] || r != operands[1]){
+                if(node->kind == ExprKind::Binary) node = arena.make<Binary>(l, static_cast<const Binary*>(node)->op, r);
+                else node = arena.make<Logical>(l, static_cast<const Logical*>(node)->op, r);
+            }
+            return Rewritten{node, level, left.size + right.size + 1};
+        });
+    }
+};
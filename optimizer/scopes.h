@@ -0,0 +1,167 @@
+#pragma once
+
+#include<array>
+#include<unordered_map>
+#include<unordered_set>
+#include<utility>
+#include<vector>
+#include"../interpreter/Stmt.h"
+#include"../scanner/Expr.h"
+#include"../utils/interner.h"
+#include"../utils/value.h"
+
+/*
+What the optimizer passes need to know about names : which declaration a name refers to at a point of
+the tree (Scopes), and which declarations are ever assigned to (AssignedVariables).
+
+And the ways they all walk expressions. Chains like a + b + c + ... parse (without recursion) into a left
+leaning spine of Binary / Logical nodes that can be a million deep, more than the native stack holds :
+walkLeftSpine loops down such a spine, everyNode visits a tree with an explicit stack.
+*/
+
+// The value of a Literal, nullptr for any other node
+inline const Value* literal(const Expr* expr){
+    if(expr == nullptr || expr->kind != ExprKind::Literal) return nullptr;
+    return &static_cast<const Literal*>(expr)->value;
+}
+
+// The operands of a node in evaluation order, nullptr past the last one
+inline std::array<const Expr*, 3> children(const Expr* expr){
+    switch(expr->kind){
+        case ExprKind::Assign:   return {static_cast<const Assign*>(expr)->value, nullptr, nullptr};
+        case ExprKind::Binary:   return {static_cast<const Binary*>(expr)->left, static_cast<const Binary*>(expr)->right, nullptr};
+        case ExprKind::Logical:  return {static_cast<const Logical*>(expr)->left, static_cast<const Logical*>(expr)->right, nullptr};
+        case ExprKind::Unary:    return {static_cast<const Unary*>(expr)->right, nullptr, nullptr};
+        case ExprKind::Grouping: return {static_cast<const Grouping*>(expr)->expression, nullptr, nullptr};
+        case ExprKind::Ternary: {
+            const Ternary* ternary = static_cast<const Ternary*>(expr);
+            return {ternary->left, ternary->middle, ternary->right};
+        }
+        default:                 return {nullptr, nullptr, nullptr};
+    }
+}
+
+// Calls visit(node) on every node of `root` (a null root has none), in no particular order. Stops and
+// returns false as soon as a visit does. Shared (hash-consed) nodes are visited once per use
+template <class Visit>
+bool everyNode(const Expr* root, Visit visit){
+    std::vector<const Expr*> pending;
+    if(root != nullptr) pending.push_back(root);
+    while(!pending.empty()){
+        const Expr* expr = pending.back();
+        pending.pop_back();
+        if(!visit(expr)) return false;
+        for(const Expr* child : children(expr)){
+            if(child != nullptr) pending.push_back(child);
+        }
+    }
+    return true;
+}
+
+// The recursive walk of a Binary / Logical node, in the same order (as Flattener::leftSpine) : goes down
+// the left operands as long as they are Binary / Logical nodes that descend(node) accepts, then
+// bottom(node) handles the node it stopped at, and up(node, result) each node of the spine on the way
+// back, given the result for its left operand. Returns the result of up for `expr`
+template <class Descend, class Bottom, class Up>
+auto walkLeftSpine(const Expr* expr, Descend descend, Bottom bottom, Up up){
+    std::vector<const Expr*> spine;
+    while((expr->kind == ExprKind::Binary || expr->kind == ExprKind::Logical) && descend(expr)){
+        spine.push_back(expr);
+        expr = children(expr)[0];
+    }
+
+    auto left = bottom(expr);
+    for(auto it = spine.rbegin(); it != spine.rend(); ++it) left = up(*it, std::move(left));
+    return left;
+}
+
+template <class Bottom, class Up>
+auto walkLeftSpine(const Expr* expr, Bottom bottom, Up up){
+    return walkLeftSpine(expr, [](const Expr*){ return true; }, bottom, up);
+}
+
+// Declarations visible while walking the tree, innermost last : maps[0] holds the globals.
+// Lox has no closures and a block runs its statements in order, so the declaration a name refers to
+// is the last one seen in the innermost scope that has one (the same rule the Resolver numbers slots by)
+struct Scopes {
+    std::vector<std::unordered_map<Symbol, const Var*>> maps{1};
+
+    void begin(){
+        maps.emplace_back();
+    }
+
+    void end(){
+        maps.pop_back();
+    }
+
+    void declare(const Var* stmt){
+        maps.back()[stmt->name.symbol] = stmt;
+    }
+
+    // nullptr for a global read before any declaration of it
+    const Var* find(Symbol name) const {
+        for(auto it = maps.rbegin(); it != maps.rend(); ++it){
+            auto found = it->find(name);
+            if(found != it->end()) return found->second;
+        }
+        return nullptr;
+    }
+};
+
+// Every declaration that some assignment writes to
+class AssignedVariables : public StmtVisitor<AssignedVariables, void> {
+
+public:
+    std::unordered_set<const Var*> targets;
+
+    void find(const std::vector<const Stmt*>& statements){
+        for(const Stmt* statement : statements) walk(statement);
+    }
+
+    void visitBlockStmt(const Block* stmt) {
+        scopes.begin();
+        for(const Stmt* statement : stmt->statements) walk(statement);
+        scopes.end();
+    }
+
+    void visitExpressionStmt(const Expression* stmt) {
+        walk(stmt->expression);
+    }
+
+    void visitIfStmt(const If* stmt) {
+        walk(stmt->condition);
+        walk(stmt->thenBranch);
+        walk(stmt->elseBranch);
+    }
+
+    void visitPrintStmt(const Print* stmt) {
+        walk(stmt->expression);
+    }
+
+    void visitVarStmt(const Var* stmt) {
+        walk(stmt->initializer);
+        scopes.declare(stmt);
+    }
+
+    void visitWhileStmt(const While* stmt) {
+        walk(stmt->condition);
+        walk(stmt->body);
+    }
+
+private:
+    Scopes scopes;
+
+    void walk(const Stmt* stmt){
+        if(stmt != nullptr) visit(stmt);
+    }
+
+    // Expressions declare nothing, so the order they are walked in doesn't matter
+    void walk(const Expr* root){
+        everyNode(root, [&](const Expr* expr){
+            if(expr->kind == ExprKind::Assign){
+                if(const Var* target = scopes.find(static_cast<const Assign*>(expr)->name.symbol)) targets.insert(target);
+            }
+            return true;
+        });
+    }
+};
@@ -0,0 +1,231 @@
+#pragma once
+
+#include<algorithm>
+#include<cstdint>
+#include<memory>
+#include<string>
+#include<string_view>
+#include<vector>
+#include"../interpreter/Stmt.h"
+#include"../interpreter/flatAst.h"
+#include"../scanner/scanner.h"
+#include"../scanner/tokenBuffer.h"
+#include"../scanner/utf8.h"
+#include"../utils/arena.h"
+#include"../utils/error.h"
+#include"parser.h"
+
+/*
+A source buffer that is kept parsed while it is being edited (editor plugins, long REPL buffers).
+
+The document is a list of top level statements, each remembering the bytes it was parsed from.
+An edit only relexes and reparses a region around it :
+
+    - from the statement before the first one the edit touches (an `else` typed after an `if`
+      joins the previous statement, and the parser never looks more than one token ahead)
+    - up to the first statement starting after the removed text
+
+Every statement after the region is reused as is : only its byte range moves, and its line numbers
+are fixed up through a per statement line shift instead of touching the nodes.
+
+The region must settle before it is spliced in, otherwise it grows (doubling) until it does, at worst
+to the end of the text, which is a plain full reparse :
+    - it ends on a line break (a comment or token can't run on into the next statement)
+    - relexing it found no error (an unterminated string or comment swallows what follows)
+    - neither its last statement nor the first reused one has syntax errors (error recovery and
+      "at end" errors depend on the tokens that come next)
+
+Each parse of a region owns a copy of just that region's text and an Arena for its nodes. Statements
+share ownership of the parse they came from, so old text stays alive exactly as long as some
+statement still views it.
+*/
+class Document{
+
+public:
+    explicit Document(std::string text, int maxDepth = Parser::defaultMaxDepth)
+    : source(std::move(text)), maxDepth(maxDepth)
+    {
+        reparse(0, 0);
+    }
+
+    // Replace `removed` bytes at `offset` with `inserted`
+    void edit(std::size_t offset, std::size_t removed, std::string_view inserted){
+        offset = std::min(offset, source.size());
+        removed = std::min(removed, source.size() - offset);
+
+        int lineDelta = static_cast<int>(std::count(inserted.begin(), inserted.end(), '\n'))
+                      - static_cast<int>(std::count(source.begin() + offset, source.begin() + offset + removed, '\n'));
+        std::int64_t delta = static_cast<std::int64_t>(inserted.size()) - static_cast<std::int64_t>(removed);
+        source.replace(offset, removed, inserted);
+
+        // First statement reaching the edit, then one more back
+        std::size_t first = std::partition_point(entries.begin(), entries.end(),
+            [&](const Entry& entry){ return entry.end < offset; }) - entries.begin();
+        if(first > 0) --first;
+
+        // Statements starting after the removed text are untouched
+        std::size_t last = std::partition_point(entries.begin() + first, entries.end(),
+            [&](const Entry& entry){ return entry.begin <= offset + removed; }) - entries.begin();
+
+        for(std::size_t i = last; i < entries.size(); ++i){
+            entries[i].begin += delta;
+            entries[i].end += delta;
+            entries[i].lineShift += lineDelta;
+        }
+
+        reparse(first, last);
+    }
+
+    std::string_view text() const {
+        return source;
+    }
+
+    // Top level statements, with null holes where a statement failed to parse (like Parser::parse)
+    const std::vector<const Stmt*>& statements() const {
+        return tree;
+    }
+
+    // Scanner and parser errors of the whole text, with their current line numbers
+    std::vector<Diagnostic> diagnostics() const {
+        std::vector<Diagnostic> all;
+        for(const Entry& entry : entries){
+            for(const Diagnostic& diagnostic : entry.diagnostics){
+                all.push_back({diagnostic.line + entry.lineShift, diagnostic.where, diagnostic.message});
+            }
+        }
+        return all;
+    }
+
+    // Flat form for the interpreter, with the line numbers of reused statements fixed up
+    FlatAst flatten() const {
+        std::vector<int> lineShifts;
+        lineShifts.reserve(entries.size());
+        for(const Entry& entry : entries) lineShifts.push_back(entry.lineShift);
+        return Flattener{}.flatten(tree, lineShifts);
+    }
+
+    // Statements parsed again by the last edit (the rest were reused)
+    std::size_t reparsed() const {
+        return lastReparsed;
+    }
+
+private:
+    // The text and nodes of one region parse
+    struct Generation {
+        std::string text;
+        Arena arena;
+    };
+
+    struct Entry {
+        const Stmt* stmt;
+        std::size_t begin, end;  // bytes of the statement in the current text
+        int firstLine;           // line it starts on, as parsed
+        int lineShift;           // current line = parsed line + lineShift
+        std::vector<Diagnostic> diagnostics;  // lines as parsed
+        std::shared_ptr<const Generation> generation;
+    };
+
+    std::string source;
+    const int maxDepth;
+    std::vector<Entry> entries;
+    std::vector<const Stmt*> tree;
+    std::size_t lastReparsed = 0;
+
+    // Reparse the text from entry `first` up to (not including) entry `last`, growing the range until it settles
+    void reparse(std::size_t first, std::size_t last){
+        while(true){
+            std::size_t begin = first == 0 ? 0 : entries[first].begin;
+            std::size_t end = last == entries.size() ? source.size() : entries[last].begin;
+            int lineShift = first == 0 ? 0 : entries[first].firstLine + entries[first].lineShift - 1;
+
+            bool scanned = true;
+            std::vector<Entry> region = parseRegion(begin, end, lineShift, scanned);
+
+            bool settled = last == entries.size()
+                || (scanned && (end == begin || source[end - 1] == '\n')
+                    && (region.empty() || region.back().diagnostics.empty())
+                    && entries[last].diagnostics.empty());
+
+            if(settled){
+                lastReparsed = region.size();
+                // Most edits keep the statement count, don't move the whole tail then
+                if(region.size() == last - first){
+                    std::move(region.begin(), region.end(), entries.begin() + first);
+                }
+                else{
+                    entries.erase(entries.begin() + first, entries.begin() + last);
+                    entries.insert(entries.begin() + first, std::make_move_iterator(region.begin()), std::make_move_iterator(region.end()));
+                }
+                break;
+            }
+
+            last = std::min(entries.size(), last + std::max<std::size_t>(1, last - first));
+        }
+
+        tree.clear();
+        tree.reserve(entries.size());
+        for(const Entry& entry : entries) tree.push_back(entry.stmt);
+    }
+
+    // Lex and parse source[begin, end) on its own. `scanned` is cleared if the scanner reported anything
+    std::vector<Entry> parseRegion(std::size_t begin, std::size_t end, int lineShift, bool& scanned){
+        auto generation = std::make_shared<Generation>();
+        generation->text.assign(source, begin, end - begin);
+        std::string_view text = generation->text;
+
+        Scanner scanner(text, 0, text.size(), true);
+        TokenBuffer tokens = scanner.scanChunk();
+        tokens.push(END_OF_FILE, static_cast<std::uint32_t>(text.size()), 0, scanner.lastLine());
+
+        std::vector<Diagnostic> scanErrors = std::move(scanner.diagnostics);
+        std::vector<std::uint32_t> scanErrorTokens = std::move(scanner.diagnosticTokens);
+        std::size_t bad = validateUtf8(text);
+        if(bad != std::string_view::npos){
+            int badLine = 1 + static_cast<int>(std::count(text.begin(), text.begin() + bad, '\n'));
+            std::uint32_t before = 0;
+            while(before + 1 < tokens.size() && tokens.offset(before) < bad) ++before;
+            scanErrors.insert(scanErrors.begin(), {badLine, "", "Invalid UTF-8 encoding."});
+            scanErrorTokens.insert(scanErrorTokens.begin(), before);
+        }
+        scanned = scanErrors.empty();
+
+        Parser parser(tokens, generation->arena, maxDepth);
+        std::vector<const Stmt*> statements = parser.parse();
+
+        std::vector<Entry> region;
+        region.reserve(statements.size());
+        std::uint32_t seen = 0;
+        for(std::size_t i = 0; i < statements.size(); ++i){
+            const Parser::Extent& extent = parser.extents[i];
+            std::size_t lastToken = extent.end > extent.first ? extent.end - 1 : extent.first;
+
+            // A string token is stamped with the line it ends on, its first byte may be lines earlier
+            std::string_view lexeme = tokens.lexeme(extent.first);
+            int firstLine = tokens.line(extent.first) - static_cast<int>(std::count(lexeme.begin(), lexeme.end(), '\n'));
+
+            Entry entry{statements[i], begin + tokens.offset(extent.first), begin + tokens.offset(lastToken) + tokens.length(lastToken),
+                        firstLine, lineShift, {}, generation};
+            entry.diagnostics.assign(parser.diagnostics.begin() + seen, parser.diagnostics.begin() + extent.diagnostics);
+            seen = extent.diagnostics;
+            region.push_back(std::move(entry));
+        }
+
+        // A scanner error belongs to the statement it was found in, or the one before the gap it was found in
+        // (regions start on a statement, so that is the one reparsed with it). Trailing garbage with no
+        // statement at all gets an empty hole to carry it
+        if(!scanErrors.empty() && region.empty()){
+            region.push_back(Entry{nullptr, begin, end, 1, lineShift, {}, generation});
+        }
+        std::vector<std::vector<Diagnostic>> owned(region.size());
+        for(std::size_t i = 0; i < scanErrors.size(); ++i){
+            auto after = std::partition_point(parser.extents.begin(), parser.extents.end(),
+                [&](const Parser::Extent& extent){ return extent.first < scanErrorTokens[i]; });
+            owned[after == parser.extents.begin() ? 0 : after - parser.extents.begin() - 1].push_back(scanErrors[i]);
+        }
+        for(std::size_t i = 0; i < region.size(); ++i){
+            region[i].diagnostics.insert(region[i].diagnostics.begin(), owned[i].begin(), owned[i].end());
+        }
+
+        return region;
+    }
+};
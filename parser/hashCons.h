@@ -0,0 +1,174 @@
+#pragma once
+
+#include<cstdint>
+#include<cstring>
+#include<functional>
+#include<type_traits>
+#include<unordered_map>
+#include<unordered_set>
+#include<utility>
+#include<variant>
+#include"../scanner/Expr.h"
+#include"../scanner/token.h"
+#include"../utils/arena.h"
+#include"../utils/tokenType.h"
+#include"../utils/value.h"
+
+/*
+Optional hash-consing for expression nodes (see Parser::shareSubtrees).
+Nodes are immutable, so every structurally identical side effect free expression (same literal, same
+`a + 1`, same condition) can be one shared node instead of a copy per occurrence.
+
+    - A node is keyed on its kind, operator, literal value or name, and its children. Children are
+      already shared, so comparing them is a pointer compare and the whole lookup is O(1) per node
+    - Assignments have a side effect : they, and everything built on top of them, are never shared
+    - Nodes the interpreter can report a runtime error at (variables, `-`, arithmetic and comparisons)
+      also key on their line, so an error inside a shared subtree still points at the right line
+
+The tree becomes a DAG : anything walking it must not assume a node has one parent.
+*/
+class HashConsTable{
+
+public:
+    // Expression nodes asked for, nodes actually allocated, and the arena bytes the difference saved
+    std::size_t requested = 0;
+    std::size_t allocated = 0;
+    std::size_t bytesSaved = 0;
+
+    template <class T, class... Args>
+    const Expr* make(Arena& arena, Args&&... args){
+        ++requested;
+
+        Key key;
+        if constexpr (std::is_same_v<T, Assign>) key.shareable = false;
+        else key = describe(static_cast<const T*>(nullptr), args...);
+
+        if(!key.shareable){
+            ++allocated;
+            return arena.make<T>(std::forward<Args>(args)...);
+        }
+
+        auto it = nodes.find(key);
+        if(it != nodes.end()){
+            bytesSaved += sizeof(T);
+            return it->second;
+        }
+
+        ++allocated;
+        const Expr* node = arena.make<T>(std::forward<Args>(args)...);
+        nodes.emplace(key, node);
+        shared.insert(node);
+        return node;
+    }
+
+private:
+    struct Key {
+        ExprKind kind = ExprKind::Literal;
+        TokenType op = NIL;
+        int line = 0;
+        std::uint8_t valueType = 0;  // variant index of a literal
+        std::uint64_t value = 0;     // literal bits, or the name's Symbol
+        const Expr* children[3] = {nullptr, nullptr, nullptr};
+        bool shareable = true;       // not part of the identity
+
+        bool operator==(const Key& other) const {
+            return kind == other.kind && op == other.op && line == other.line && valueType == other.valueType
+                && value == other.value && children[0] == other.children[0] && children[1] == other.children[1]
+                && children[2] == other.children[2];
+        }
+    };
+
+    struct KeyHash {
+        std::size_t operator()(const Key& key) const {
+            std::size_t hash = static_cast<std::size_t>(key.kind) * 31 + key.op;
+            auto mix = [&](std::size_t part){ hash ^= part + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2); };
+            mix(static_cast<std::size_t>(key.line));
+            mix(key.valueType);
+            mix(std::hash<std::uint64_t>{}(key.value));
+            for(const Expr* child : key.children) mix(std::hash<const Expr*>{}(child));
+            return hash;
+        }
+    };
+
+    std::unordered_map<Key, const Expr*, KeyHash> nodes;
+    std::unordered_set<const Expr*> shared;
+
+    // Only children that are themselves shared nodes can be part of a shared node
+    bool isShared(const Expr* child) const {
+        return shared.count(child) != 0;
+    }
+
+    // Runtime errors at these operators report the line of the operator
+    static bool canFail(TokenType op){
+        return op != EQUAL_EQUAL && op != BANG_EQUAL && op != COMMA && op != BANG;
+    }
+
+    Key describe(const Literal*, const Value& value){
+        Key key;
+        key.kind = ExprKind::Literal;
+        key.valueType = static_cast<std::uint8_t>(value.index());
+        if(std::holds_alternative<bool>(value)) key.value = std::get<bool>(value);
+        else if(std::holds_alternative<double>(value)) std::memcpy(&key.value, &std::get<double>(value), sizeof(double));
+        else if(std::holds_alternative<Symbol>(value)) key.value = reinterpret_cast<std::uintptr_t>(std::get<Symbol>(value).text);
+        else if(std::holds_alternative<std::string>(value)) key.shareable = false;
+        return key;
+    }
+
+    Key describe(const Variable*, const Token& name){
+        Key key;
+        key.kind = ExprKind::Variable;
+        key.line = name.line;
+        key.value = reinterpret_cast<std::uintptr_t>(name.symbol.text);
+        return key;
+    }
+
+    Key describe(const Grouping*, const Expr* expression){
+        Key key;
+        key.kind = ExprKind::Grouping;
+        key.children[0] = expression;
+        key.shareable = isShared(expression);
+        return key;
+    }
+
+    Key describe(const Unary*, const Token& op, const Expr* right){
+        Key key;
+        key.kind = ExprKind::Unary;
+        key.op = op.type;
+        key.line = canFail(op.type) ? op.line : 0;
+        key.children[0] = right;
+        key.shareable = isShared(right);
+        return key;
+    }
+
+    Key describe(const Binary*, const Expr* left, const Token& op, const Expr* right){
+        Key key;
+        key.kind = ExprKind::Binary;
+        key.op = op.type;
+        key.line = canFail(op.type) ? op.line : 0;
+        key.children[0] = left;
+        key.children[1] = right;
+        key.shareable = isShared(left) && isShared(right);
+        return key;
+    }
+
+    Key describe(const Logical*, const Expr* left, const Token& op, const Expr* right){
+        Key key;
+        key.kind = ExprKind::Logical;
+        key.op = op.type;
+        key.children[0] = left;
+        key.children[1] = right;
+        key.shareable = isShared(left) && isShared(right);
+        return key;
+    }
+
+    Key describe(const Ternary*, const Expr* left, const Token& leftOp, const Expr* middle, const Token&, const Expr* right){
+        Key key;
+        key.kind = ExprKind::Ternary;
+        key.op = leftOp.type;
+        key.children[0] = left;
+        key.children[1] = middle;
+        key.children[2] = right;
+        key.shareable = isShared(left) && isShared(middle) && isShared(right);
+        return key;
+    }
+};
@@ -0,0 +1,142 @@
+#pragma once
+
+#include<algorithm>
+#include<cstdint>
+#include<thread>
+#include<vector>
+#include"../interpreter/Stmt.h"
+#include"../scanner/tokenBuffer.h"
+#include"../utils/arena.h"
+#include"../utils/error.h"
+#include"../utils/tokenType.h"
+#include"hashCons.h"
+#include"parser.h"
+
+/*
+Parses very long token streams on several threads and produces exactly the statements (and errors) the serial Parser would.
+
+    1) One pass over the token types tracks the paren/brace depth and picks one split point per chunk :
+       just after a ';' or '}' at depth 0 that is not followed by an `else`. Top level statements never
+       look further ahead than that, so each chunk holds whole statements and parses the same way alone.
+    2) Each chunk gets its own Parser and Arena (one thread per chunk), stopping at the chunk end as if it was EOF.
+    3) The statements are concatenated in order and the chunk arenas are handed over to the caller's arena.
+
+The depth scan trusts the brackets to be balanced. Rather than guess how a broken file would have split,
+the first chunk with a syntax error and everything after it are thrown away and parsed again serially,
+so errors are always found and reported exactly as the serial parser does.
+
+Small inputs just go through the serial Parser.
+*/
+class ParallelParser{
+
+public:
+    static constexpr std::size_t minParallelTokens = 1 << 18;  // below this threads cost more than they save
+    static constexpr std::size_t minChunkTokens = 1 << 16;
+
+    ParallelParser(const TokenBuffer& tokens, Arena& arena, int maxDepth = Parser::defaultMaxDepth,
+                   unsigned threads = std::thread::hardware_concurrency())
+    : tokens(tokens), arena(arena), maxDepth(maxDepth), threads(std::max(threads, 1u))
+    {}
+
+    // Hash-cons expressions (see Parser::shareSubtrees). Each chunk shares only within itself
+    void shareSubtrees(){
+        hashCons = true;
+    }
+
+    std::vector<const Stmt*> parse(){
+        std::size_t chunks = std::min<std::size_t>(threads, tokens.size() / minChunkTokens);
+        if(tokens.size() < minParallelTokens || chunks < 2) return parseSerial();
+
+        std::vector<std::uint32_t> bounds = splitPoints(chunks);
+        chunks = bounds.size() - 1;
+        if(chunks < 2) return parseSerial();
+
+        std::vector<Arena> arenas(chunks);
+        std::vector<std::vector<const Stmt*>> results(chunks);
+        std::vector<char> failed(chunks, false);
+
+        auto parseOne = [&](std::size_t i){
+            Parser parser(tokens, arenas[i], maxDepth, static_cast<int>(bounds[i]), static_cast<int>(bounds[i + 1]));
+            HashConsTable table;
+            if(hashCons) parser.shareSubtrees(table);
+            results[i] = parser.parse();
+            failed[i] = !parser.diagnostics.empty();
+        };
+
+        std::vector<std::thread> workers;
+        for(std::size_t i = 1; i < chunks; ++i) workers.emplace_back(parseOne, i);
+        parseOne(0);
+        for(std::thread& worker : workers) worker.join();
+
+        // Chunks before the first one with an error parsed exactly as the serial parser would have
+        std::size_t clean = std::find(failed.begin(), failed.end(), true) - failed.begin();
+
+        std::size_t total = 0;
+        for(std::size_t i = 0; i < clean; ++i) total += results[i].size();
+
+        std::vector<const Stmt*> statements;
+        statements.reserve(total);
+        for(std::size_t i = 0; i < clean; ++i){
+            statements.insert(statements.end(), results[i].begin(), results[i].end());
+            arena.adopt(std::move(arenas[i]));
+        }
+
+        if(clean < chunks){
+            std::vector<const Stmt*> rest = parseSerial(bounds[clean]);
+            statements.insert(statements.end(), rest.begin(), rest.end());
+        }
+        return statements;
+    }
+
+    // Every syntax error found, in source order (only ever filled by the serial parse of the tail)
+    std::vector<Diagnostic> diagnostics;
+
+private:
+    const TokenBuffer& tokens;
+    Arena& arena;
+    const int maxDepth;
+    const unsigned threads;
+    bool hashCons = false;
+
+    // Parse from token `first` to the end of the buffer on this thread
+    std::vector<const Stmt*> parseSerial(std::uint32_t first = 0){
+        Parser parser(tokens, arena, maxDepth, static_cast<int>(first), static_cast<int>(tokens.size()) - 1);
+        HashConsTable table;
+        if(hashCons) parser.shareSubtrees(table);
+        std::vector<const Stmt*> statements = parser.parse();
+        diagnostics = std::move(parser.diagnostics);
+        return statements;
+    }
+
+    // Returns chunk boundaries [0, s1, s2, ..., EOF index]. Fewer chunks come back if the
+    // brackets never close again before every target is reached
+    std::vector<std::uint32_t> splitPoints(std::size_t chunks){
+        const std::uint32_t eof = static_cast<std::uint32_t>(tokens.size() - 1);
+        std::vector<std::uint32_t> bounds{0};
+        int depth = 0;
+        std::uint32_t i = 0;
+
+        for(std::size_t chunk = 1; chunk < chunks && i < eof; ++chunk){
+            const std::uint32_t target = static_cast<std::uint32_t>(tokens.size() * chunk / chunks);
+
+            for(; i < eof; ++i){
+                TokenType type = tokens.type(i);
+                if(type == LEFT_PAREN || type == LEFT_BRACE) ++depth;
+                else if(type == RIGHT_PAREN || type == RIGHT_BRACE) --depth;
+
+                if(i + 1 >= target && depth == 0 && (type == SEMICOLON || type == RIGHT_BRACE)
+                   && tokens.type(i + 1) != ELSE && i + 1 < eof){
+                    break;
+                }
+            }
+
+            if(i < eof){
+                ++i;  // split right after the ';' or '}'
+                bounds.push_back(i);
+            }
+        }
+
+        bounds.push_back(eof);
+        return bounds;
+    }
+};
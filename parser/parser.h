@@ -1,12 +1,16 @@
 #pragma once
 
+#include<array>
+#include<cstdint>
 #include<iostream>
 #include<vector>
 #include<string>
-#include<stdexcept>
 #include<utility> // std::move
 #include"../interpreter/Stmt.h"
 #include"../scanner/Expr.h"
+#include"../scanner/tokenBuffer.h"
+#include"../utils/arena.h"
+#include"hashCons.h"
 #include"../utils/tokenType.h"
 #include "../utils/error.h"
 
@@ -60,6 +64,10 @@ b) Ternary operator (?:) - right associative, precedence after comma
     +0) ternary → ( expression "?" expression : )* expression
 ******************
 
+Statements are parsed by recursive descent. Expressions (rules 0 to 5) use a table driven Pratt parser instead of
+one function per precedence level : a single loop in parsePrecedence() reads each operator's binding power from
+infixPrecedence, so a lone literal costs one call instead of descending through every level.
+
 
 */
 
@@ -67,39 +75,115 @@ class Parser{
 
 public:
     
-    Parser(std::vector<Token> _tokens) : tokens(_tokens) {};
+    // Nesting levels (parentheses, unary operators, right operands, nested statements) the parser
+    // accepts before giving up. Each level costs a few native stack frames
+    static constexpr int defaultMaxDepth = 2000;
 
-    // Main function to kick off parsing
-    // For now, if we face an error, we return null instead of sync (As we haven't implemented statements yet)
-    std::vector<std::shared_ptr<Stmt>> parse(){
-        try
-        {
-            std::vector<std::shared_ptr<Stmt>> statements;
-            while(!isAtEnd()){
-                statements.push_back(declaration());
-            }
+    // The parser borrows the scanner's buffer, it must outlive the parser
+    // Nodes are allocated from `arena`, which owns the returned tree
+    Parser(const TokenBuffer& _tokens, Arena& arena, int maxDepth = defaultMaxDepth)
+    : tokens(_tokens), arena(arena), end(static_cast<int>(_tokens.size()) - 1), maxDepth(maxDepth) {};
 
-            return statements;
-        }
-        catch(ParseError error)
-        {
-            return {};
+    // Parse only the tokens [first, end), as if `end` was the EOF (see ParallelParser)
+    Parser(const TokenBuffer& _tokens, Arena& arena, int maxDepth, int first, int end)
+    : tokens(_tokens), arena(arena), current(first), end(end), maxDepth(maxDepth) {};
+
+    // Main function to kick off parsing
+    // A statement that fails to parse is left as a null entry, the errors are in `diagnostics`
+    std::vector<const Stmt*> parse(){
+        std::vector<const Stmt*> statements;
+        while(!isAtEnd()){
+            std::uint32_t first = static_cast<std::uint32_t>(current);
+            statements.push_back(declaration());
+            extents.push_back({first, static_cast<std::uint32_t>(current), static_cast<std::uint32_t>(diagnostics.size())});
         }
-        
+
+        return statements;
+    }
+
+    // Share structurally identical side effect free subexpressions through `table` instead of
+    // allocating a copy of each (the returned statements then hold a DAG, see HashConsTable)
+    void shareSubtrees(HashConsTable& table){
+        shared = &table;
     }
 
+    // Every syntax error found, in source order. The parser never prints : the caller reports them
+    std::vector<Diagnostic> diagnostics;
+
+    // Tokens [first, end) each top level statement was parsed from, and the size of `diagnostics` once
+    // it was done (so its own errors are the ones after the previous statement's count). See Document
+    struct Extent {
+        std::uint32_t first;
+        std::uint32_t end;
+        std::uint32_t diagnostics;
+    };
+    std::vector<Extent> extents;
+
 
 private:
-    
-    
-    // (ERROR RECOVERY) This is a simple class to which we will use to catch the syntax errors
-    // As we want to keep parsing the entire file
-    struct ParseError: public std::runtime_error {
-        using std::runtime_error::runtime_error;
+
+    // Binding power of the infix operators, from loosest to tightest (grammar rules 0 to 6)
+    enum Precedence : std::uint8_t {
+        PREC_NONE,        // not an infix operator, ends the expression
+        PREC_COMMA,       // ,
+        PREC_ASSIGNMENT,  // =
+        PREC_TERNARY,     // ?:
+        PREC_OR,          // or
+        PREC_AND,         // and
+        PREC_EQUALITY,    // == !=
+        PREC_COMPARISON,  // < > <= >=
+        PREC_TERM,        // + -
+        PREC_FACTOR,      // * /
+        PREC_UNARY        // ! - (prefix, only used for their operand)
     };
 
-    const std::vector<Token> tokens;
+    // One entry per TokenType, so finding the next operator is a single byte load
+    static constexpr std::array<Precedence, END_OF_FILE + 1> infixPrecedence = []{
+        std::array<Precedence, END_OF_FILE + 1> table{};
+        table[COMMA] = PREC_COMMA;
+        table[EQUAL] = PREC_ASSIGNMENT;
+        table[QUESTION] = PREC_TERNARY;
+        table[OR] = PREC_OR;
+        table[AND] = PREC_AND;
+        table[BANG_EQUAL] = table[EQUAL_EQUAL] = PREC_EQUALITY;
+        table[GREATER] = table[GREATER_EQUAL] = table[LESS] = table[LESS_EQUAL] = PREC_COMPARISON;
+        table[MINUS] = table[PLUS] = PREC_TERM;
+        table[SLASH] = table[STAR] = PREC_FACTOR;
+        return table;
+    }();
+
+    const TokenBuffer& tokens;
+    Arena& arena;
     int current = 0;
+    const int end;  // index of the EOF token, or of the first token past the range being parsed
+
+    const int maxDepth;
+    int depth = 0;
+    bool abandoned = false;
+    HashConsTable* shared = nullptr;
+
+    // Every expression node is made here, so hash-consing can hand back an existing one
+    template <class T, class... Args>
+    const Expr* node(Args&&... args){
+        if(shared != nullptr) return shared->make<T>(arena, std::forward<Args>(args)...);
+        return arena.make<T>(std::forward<Args>(args)...);
+    }
+
+    // Counts one level of nesting for as long as it lives
+    struct Nesting {
+        int& depth;
+        Nesting(int& depth) : depth(++depth) {}
+        ~Nesting(){ --depth; }
+    };
+
+    // Past maxDepth the input is machine generated or hostile : report it once and give up on the rest of
+    // the file (jumping to EOF), rather than recovering at every one of the enclosing levels
+    std::nullptr_t tooDeep(){
+        error(peek(), "Nesting is too deep.");
+        abandoned = true;
+        current = end;
+        return nullptr;
+    }
     /// Helper functions ///
     
     template <class... T>
@@ -107,41 +191,53 @@ private:
     
     bool check(TokenType type){
         if(isAtEnd()) return false;
-        return peek().type == type;
+        return tokens.type(current) == type;
     }
     
-    // Helper : Consumes current token, returns it and advances
-    Token advance(){
+    // The cursor is just an index into the token buffer : moving it and checking types never builds a Token.
+    // peek()/previous() materialize one, so they are only called for tokens that end up in an AST node or an error
+
+    // Helper : Consumes current token and advances
+    void advance(){
         if(!isAtEnd()) ++current;
-        return previous();
     }
     bool isAtEnd(){
-        return peek().type == END_OF_FILE;
+        return current == end;
     }
 
     Token peek(){
-        return tokens[current];
+        return tokens.token(current);
     }
 
     Token previous(){
-        return tokens[current-1];
+        return tokens.token(current-1);
     }
 
     //// ERROR RECOVERY ////
 
-    // We return the error instead of throwing it because we want to let the calling method inside the parser decide whether to unwind or not.
-    ParseError error(const Token& token, std::string message){
-        ::error(token,message);
-        return ParseError{""};
+    // No exceptions : a rule that hits a syntax error records it and returns nullptr, and every caller
+    // passes the nullptr straight up to declaration(), which synchronizes. A file with thousands of errors
+    // costs thousands of early returns instead of thousands of stack unwinds.
+
+    // Returns nullptr so a rule can `return error(...)` (the caller decides whether to give up or keep going)
+    std::nullptr_t error(const Token& token, std::string message){
+        if(abandoned) return nullptr;
+        diagnostics.push_back(diagnostic(token, std::move(message)));
+        return nullptr;
     }
 
-    Token consume(TokenType type, std::string message){
-        if(check(type)) return advance();
+    // The message stays a plain literal until it is actually reported
+    bool consume(TokenType type, const char* message){
+        if(check(type)){
+            advance();
+            return true;
+        }
 
-        throw error(peek(), message);
+        error(peek(), message);
+        return false;
     }
     
-    // This function is called when we catch a syntax error while parsing
+    // This function is called when a statement fails to parse
     // Idea is to discard the current recursion stack and start over again
     // by ignoring all the remaining tokens until we reach a new statement
     // this prevents reporting cascading errors caused due to the very first error
@@ -149,9 +245,9 @@ private:
         advance();
 
         while(!isAtEnd()){
-            if(previous().type == SEMICOLON) return;
+            if(tokens.type(current-1) == SEMICOLON) return;
 
-            switch(peek().type){
+            switch(tokens.type(current)){
                 case CLASS:
                 case FUN:
                 case VAR:
@@ -171,27 +267,19 @@ private:
     
     
     /// Driver functions ///
-    std::shared_ptr<Stmt> declaration();
-    std::shared_ptr<Stmt> varDeclaration();
-    std::shared_ptr<Stmt> statement();  
-    std::shared_ptr<Stmt> printStatement();  
-    std::shared_ptr<Stmt> ifStatement();  
-    std::shared_ptr<Stmt> whileStatement();  
-    std::shared_ptr<Stmt> forStatement();  
-    std::shared_ptr<Stmt> expressionStatement();  
-    std::vector<std::shared_ptr<Stmt>> block();  
-    std::shared_ptr<Expr> comma();      // 0th grammar rule
-    std::shared_ptr<Expr> assignment();  
-    std::shared_ptr<Expr> Or();  
-    std::shared_ptr<Expr> And();  
-    std::shared_ptr<Expr> ternary();    // +0th grammar rule
-    std::shared_ptr<Expr> expression(); // 1st grammar rule
-    std::shared_ptr<Expr> equality();   // 2nd grammar rule
-    std::shared_ptr<Expr> comparison(); // 3rd grammar rule
-    std::shared_ptr<Expr> term();       // 4rd grammar rule
-    std::shared_ptr<Expr> factor();     // 5rd grammar rule
-    std::shared_ptr<Expr> unary();      // 6rd grammar rule
-    std::shared_ptr<Expr> primary();    // 7rd grammar rule
+    const Stmt* declaration();
+    const Stmt* varDeclaration();
+    const Stmt* statement();  
+    const Stmt* printStatement();  
+    const Stmt* ifStatement();  
+    const Stmt* whileStatement();  
+    const Stmt* forStatement();  
+    const Stmt* expressionStatement();  
+    bool block(std::vector<const Stmt*>& statements);  
+    const Expr* expression(); // 1st grammar rule
+    const Expr* parsePrecedence(Precedence minPrecedence); // comma down to factor
+    const Expr* unary();      // 6rd grammar rule
+    const Expr* primary();    // 7rd grammar rule
 
 };
 
@@ -210,324 +298,245 @@ bool Parser::match(T... types){
 
 }
 
-std::shared_ptr<Stmt> Parser::declaration(){
-    try {
-        if(match(VAR)) return varDeclaration();
+const Stmt* Parser::declaration(){
+    const Stmt* stmt = match(VAR) ? varDeclaration() : statement();
 
-        return statement();
-    } catch (ParseError error){
-        synchronize();
-        return nullptr;
-    }
+    // Error recovery point : skip to the next statement and leave a hole for this one
+    if(stmt == nullptr) synchronize();
+    return stmt;
 }
 
-std::shared_ptr<Stmt> Parser::varDeclaration(){
-    Token name = consume(IDENTIFIER, "Expect variable name.");
+const Stmt* Parser::varDeclaration(){
+    if(!consume(IDENTIFIER, "Expect variable name.")) return nullptr;
+    Token name = previous();
 
-    std::shared_ptr<Expr> initializer = nullptr;
+    const Expr* initializer = nullptr;
     if(match(EQUAL)){
-        // initializer = expression();
         initializer = expression();
+        if(initializer == nullptr) return nullptr;
     }
 
-    consume(SEMICOLON, "Expect ';' after variable declaration.");
+    if(!consume(SEMICOLON, "Expect ';' after variable declaration.")) return nullptr;
     
-    return std::make_shared<Var>(name,initializer);
+    return arena.make<Var>(name,initializer);
 }
 
-std::shared_ptr<Stmt> Parser::statement(){
+const Stmt* Parser::statement(){
+    Nesting nesting(depth);
+    if(depth > maxDepth) return tooDeep();
+
     if(match(PRINT)) return printStatement();
     
     if(match(WHILE)) return whileStatement();
     
     if(match(FOR)) return forStatement();
 
-    if(match(LEFT_BRACE)) return std::make_shared<Block>(block());
+    if(match(LEFT_BRACE)){
+        std::vector<const Stmt*> statements;
+        if(!block(statements)) return nullptr;
+        return arena.make<Block>(std::move(statements));
+    }
 
     if(match(IF)) return ifStatement();
     
     return expressionStatement();
 }
 
-std::shared_ptr<Stmt> Parser::expressionStatement(){
-    std::shared_ptr<Expr> expr = expression();
-    consume(SEMICOLON, "Exprect ';' after value.");
+const Stmt* Parser::expressionStatement(){
+    const Expr* expr = expression();
+    if(expr == nullptr || !consume(SEMICOLON, "Exprect ';' after value.")) return nullptr;
 
-    return std::make_shared<Expression>(expr);
+    return arena.make<Expression>(expr);
 }
 
-// Parse block statements
-std::vector<std::shared_ptr<Stmt>> Parser::block(){
-    std::vector<std::shared_ptr<Stmt>> statements;
-
+// Parse block statements into `statements`, false if the block is not closed
+// (errors inside the block are recovered from by declaration() and don't fail the block)
+bool Parser::block(std::vector<const Stmt*>& statements){
     while(!check(RIGHT_BRACE) && !isAtEnd()) {
         statements.push_back(declaration());
     }
     
-    consume(RIGHT_BRACE, "Expect '}' after block.");
-
-    return statements;
+    return consume(RIGHT_BRACE, "Expect '}' after block.");
 }
 
-std::shared_ptr<Stmt> Parser::printStatement(){
-    std::shared_ptr<Expr> value = expression();
-    consume(SEMICOLON, "Expect ';' after value.");
-    return std::make_shared<Print>(value);
+const Stmt* Parser::printStatement(){
+    const Expr* value = expression();
+    if(value == nullptr || !consume(SEMICOLON, "Expect ';' after value.")) return nullptr;
+    return arena.make<Print>(value);
 }
 
 
-std::shared_ptr<Stmt> Parser::whileStatement(){
-    consume(LEFT_PAREN, "Expect '(' after 'while'.");
-    std::shared_ptr<Expr> condition = expression();
-    consume(RIGHT_PAREN,"Expect ')' after condition.");
-    std::shared_ptr<Stmt> body = statement();
+const Stmt* Parser::whileStatement(){
+    if(!consume(LEFT_PAREN, "Expect '(' after 'while'.")) return nullptr;
+    const Expr* condition = expression();
+    if(condition == nullptr || !consume(RIGHT_PAREN,"Expect ')' after condition.")) return nullptr;
+    const Stmt* body = statement();
+    if(body == nullptr) return nullptr;
 
-    return std::make_shared<While>(condition,body);
+    return arena.make<While>(condition,body);
 }
 
 // The for statement is de-sugared to the native while statement. Re-using same methods
-std::shared_ptr<Stmt> Parser::forStatement(){
-    consume(LEFT_PAREN, "Expect '(' after 'for'.");
+const Stmt* Parser::forStatement(){
+    if(!consume(LEFT_PAREN, "Expect '(' after 'for'.")) return nullptr;
     
     // Parse initializer/expression if present
-    std::shared_ptr<Stmt> initializer;
+    const Stmt* initializer;
     if(match(SEMICOLON)) {
         initializer = nullptr;
-    } else if(match(VAR)){
-        initializer = varDeclaration();
     } else {
-        initializer = expressionStatement();
+        initializer = match(VAR) ? varDeclaration() : expressionStatement();
+        if(initializer == nullptr) return nullptr;
     }
 
     // Parse condition
-    std::shared_ptr<Expr> condition = nullptr;
+    const Expr* condition = nullptr;
     if(!check(SEMICOLON)) {
         condition = expression();
+        if(condition == nullptr) return nullptr;
     }
 
-    consume(SEMICOLON, "Expect ';' after loop condition.");
+    if(!consume(SEMICOLON, "Expect ';' after loop condition.")) return nullptr;
 
     // Parse Incrementer
-    std::shared_ptr<Expr> increment = nullptr;
+    const Expr* increment = nullptr;
     if(!check(SEMICOLON)){
         increment = expression();
+        if(increment == nullptr) return nullptr;
     }
 
-    consume(RIGHT_PAREN, "Expect ')' after for clauses.");
+    if(!consume(RIGHT_PAREN, "Expect ')' after for clauses.")) return nullptr;
 
     // Parse body
-    std::shared_ptr<Stmt> body = statement();
+    const Stmt* body = statement();
+    if(body == nullptr) return nullptr;
 
     // Piece together the "for components" into a while statement
     if(increment != nullptr){
-        body = std::make_shared<Block>(std::vector<std::shared_ptr<Stmt>>{body, std::make_shared<Expression>(increment)});
+        body = arena.make<Block>(std::vector<const Stmt*>{body, arena.make<Expression>(increment)});
     }
 
-    if(condition == nullptr) condition = std::make_shared<Literal>(true);
+    if(condition == nullptr) condition = node<Literal>(Value{true});
 
     
-    body = std::make_shared<While>(condition,body);
+    body = arena.make<While>(condition,body);
 
     if(initializer != nullptr){
-        body = std::make_shared<Block>(std::vector<std::shared_ptr<Stmt>>{initializer,body});
+        body = arena.make<Block>(std::vector<const Stmt*>{initializer,body});
     }
 
     return body;
 }
 
-std::shared_ptr<Stmt> Parser::ifStatement(){
-    consume(LEFT_PAREN, "Expect '(' after 'if'.");
-    std::shared_ptr<Expr> condition = expression();
-    consume(RIGHT_PAREN, "Expect ')' after if condition.");
+const Stmt* Parser::ifStatement(){
+    if(!consume(LEFT_PAREN, "Expect '(' after 'if'.")) return nullptr;
+    const Expr* condition = expression();
+    if(condition == nullptr || !consume(RIGHT_PAREN, "Expect ')' after if condition.")) return nullptr;
 
-    std::shared_ptr<Stmt> thenBranch = statement();
+    const Stmt* thenBranch = statement();
+    if(thenBranch == nullptr) return nullptr;
     
-    std::shared_ptr<Stmt> elseBranch = nullptr;
+    const Stmt* elseBranch = nullptr;
     if(match(ELSE)){
         elseBranch = statement();
+        if(elseBranch == nullptr) return nullptr;
     }
 
-    return std::make_shared<If>(condition,thenBranch,elseBranch);
+    return arena.make<If>(condition,thenBranch,elseBranch);
 }
 
-std::shared_ptr<Expr> Parser::expression(){
-    return comma();
+const Expr* Parser::expression(){
+    return parsePrecedence(PREC_COMMA);
 }
 
-std::shared_ptr<Expr> Parser::comma(){
-    // std::shared_ptr<Expr> expr = expression();
-    std::shared_ptr<Expr> expr = assignment();
-
-    while(match(COMMA)) {
-        
-        Token op = previous();
-        
-        std::shared_ptr<Expr> right = assignment();
-
-        expr = std::make_shared<Binary>(expr,std::move(op),right);
-    }
+// Pratt parser : one loop over the binding powers replaces the comma -> assignment -> ternary -> ... -> factor chain
+// Parse a prefix expression, then keep folding infix operators into it for as long as they bind at least as
+// tightly as minPrecedence. Each operand on the right is parsed with the precedence that operator needs :
+//   - left associative operators (most of them) parse their right side one level higher
+//   - assignment is right associative and parses its value at its own level
+//   - the ternary's middle and right parts are parsed at the ternary level (right associative)
+const Expr* Parser::parsePrecedence(Precedence minPrecedence){
+    // Chains of left associative operators (a + b + c ...) stay in the loop below and don't nest,
+    // only operands that need their own call (parentheses, unary, right sides) count as a level
+    Nesting nesting(depth);
+    if(depth > maxDepth) return tooDeep();
+
+    const Expr* expr = unary();
+    if(expr == nullptr) return nullptr;
+
+    while(true){
+        Precedence precedence = infixPrecedence[tokens.type(current)];
+        if(precedence == PREC_NONE || precedence < minPrecedence) break;
+
+        int op = current;
+        advance();
 
-    return expr;
+        switch(precedence){
+            case PREC_ASSIGNMENT: {
+                const Expr* value = parsePrecedence(PREC_ASSIGNMENT); // Right-associative
+                if(value == nullptr) return nullptr;
+
+                // Check the node's kind tag to see if Expr is of dervied type "Variable"
+                // (nodes have no vtable, so this replaces a dynamic_cast)
+                if(expr->kind == ExprKind::Variable) {
+                    Token name = static_cast<const Variable*>(expr)->name;
+                    expr = node<Assign>(std::move(name),value);
+                }
+                else {
+                    // Report but keep going with the left side, there is no need to synchronize
+                    error(tokens.token(op), "Invalid assignment target.");
+                }
+                break;
+            }
 
-}
+            case PREC_TERNARY: {
+                // Support nested statements like (a == b ? ( c == d ? d : e ) : f)
+                const Expr* middle = parsePrecedence(PREC_TERNARY);
+                if(middle == nullptr) return nullptr;
 
-std::shared_ptr<Expr> Parser::assignment(){
-    std::shared_ptr<Expr> expr = ternary(); // To get the left identifier
+                // If we have a random "?" its an error
+                if(!match(COLON)) return error(peek(),"Expected ':' after ternary operator '?'.");
 
-    if(match(EQUAL)){
-        Token equals = previous();
-        std::shared_ptr<Expr> value = assignment(); // Right-associative
-        
-        // Using dynamic_cast to check if Expr is of dervied type "Variable"
-        // dynamic_cast<T*>(base) returns the pointer to T* after casting base to T if
-        // T actually is of derived type. Otherwise return NULL (happens at runtime)
-        if(Variable* v = dynamic_cast<Variable*>(expr.get())) {
-
-            Token name = v->name;
-            return std::make_shared<Assign>(std::move(name),value);
-        }
-
-        error(equals, "Invalid assignment target.");
-    }
+                Token middleOp = previous();
+                const Expr* right = parsePrecedence(PREC_TERNARY);
+                if(right == nullptr) return nullptr;
+                expr = node<Ternary>(expr, tokens.token(op), middle, std::move(middleOp), right);
+                break;
+            }
 
-    return expr;
-}
+            case PREC_OR:
+            case PREC_AND: {
+                const Expr* right = parsePrecedence(static_cast<Precedence>(precedence + 1));
+                if(right == nullptr) return nullptr;
+                expr = node<Logical>(expr,tokens.token(op),right);
+                break;
+            }
 
-std::shared_ptr<Expr> Parser::ternary(){
-    std::shared_ptr<Expr> expr = Or();
-
-    // Are we in a conditional block?
-    if(match(QUESTION)){
-        // Store the "?"
-        Token leftOp = previous();
-        // Look for True
-        std::shared_ptr<Expr> middle = ternary(); // Support nested statements like (a == b ? ( c == d ? d : e ) : f)
-        // Look for the False
-        if(match(COLON)){
-            
-            Token middleOp = previous();
-            std::shared_ptr<Expr> right = ternary(); // Support nested statements like (a ? b : ( d == c ? e : f) : g )
-
-            // Combine all these into a new AST node
-            expr = std::make_shared<Ternary>(expr, leftOp, middle, middleOp, right);
-        }
-        // If we have a random "?" its an error
-        else{
-            throw error(peek(),"Expected ':' after ternary operator '?'.");
+            default: {
+                // Using expr as the left operand makes chains left associative. eg. ( (a == b) == c ) == d
+                const Expr* right = parsePrecedence(static_cast<Precedence>(precedence + 1));
+                if(right == nullptr) return nullptr;
+                expr = node<Binary>(expr,tokens.token(op),right);
+                break;
+            }
         }
-
-    }
-
-    return expr;
-
-}
-
-std::shared_ptr<Expr> Parser::Or(){
-    std::shared_ptr<Expr> expr = And();
-
-    while(match(OR)){
-        Token op = previous();
-        std::shared_ptr<Expr> right = And();
-        expr = std::make_shared<Logical>(expr,op,right);
-    }
-
-    return expr;
-}
-
-std::shared_ptr<Expr> Parser::And(){
-    std::shared_ptr<Expr> expr = equality();
-
-    while(match(AND)){
-        Token op = previous();
-        std::shared_ptr<Expr> right = equality();
-        expr = std::make_shared<Logical>(expr,op,right);
-    }
-
-    return expr;
-}
-
-///// START : Binary operators (Lowest precedence) /////
-
-// 1) & 2) -> equality -> comparision ( ("!=") | ("==") comparision )*
-// Example : (sequence of operations) (== | !=) (sequence of operations)
-
-// We keep parse the expressions on the left until we reach == or !=
-// Then we parse the expressions on the right
-// Combine both into a binary expr (eg. x == y)
-std::shared_ptr<Expr> Parser::equality(){
-
-    std::shared_ptr<Expr> expr = comparison();
-
-    while(match(BANG_EQUAL, EQUAL_EQUAL)) {
-        Token op = previous();
-        std::shared_ptr<Expr> right = comparison();
-        // Notice we are using expr as the left operator
-        // For each iteration, we create a new binary expression using the previous one as the left operand.
-        // eg. ( (a == b) == c )== d 
-        expr = std::make_shared<Binary>(expr,std::move(op),right);
-    }
-
-    // If an equality operator is not found, we don't go inside the while loop
-    // In this case we return comparision() as it is
-    // This matches an equality operator or higher precedence
-    return expr;
-}
-
-
-// 3) comparison     → term ( ( ">" | ">=" | "<" | "<=" ) term )* ;
-// Exactly same logic as 1)
-std::shared_ptr<Expr> Parser::comparison(){
-    std::shared_ptr<Expr> expr = term();
-
-    while(match(GREATER, GREATER_EQUAL, LESS, LESS_EQUAL)){
-        Token op = previous();
-        std::shared_ptr<Expr> right = term();
-        expr = std::make_shared<Binary>(expr,std::move(op),right);
-    }
-
-    return expr;
-}
-
-// 4) term → factor ( ( "-" | "+" ) factor )* ;
-std::shared_ptr<Expr> Parser::term(){
-    std::shared_ptr<Expr> expr = factor();
-
-    while(match(MINUS, PLUS)){
-        Token op = previous();
-        std::shared_ptr<Expr> right = factor();
-        expr = std::make_shared<Binary>(expr,std::move(op),right);
-    }
-
-    return expr;
-}
-///// END : Binary operators /////
-
-
-///// START : Unary operators (Medium precedence) /////
-
-// 5) factor → unary ( ( "/" | "*" ) unary )* ;
-std::shared_ptr<Expr> Parser::factor(){
-    std::shared_ptr<Expr> expr = unary();
-
-    while(match(SLASH, STAR)){
-        Token op = previous();
-        std::shared_ptr<Expr> right = unary();
-        expr = std::make_shared<Binary>(expr,std::move(op),right);
     }
 
     return expr;
 }
 
 
+///// START : Unary operators /////
 
 // 6) unary → ( "!" | "-" ) unary | primary
-std::shared_ptr<Expr> Parser::unary(){
+const Expr* Parser::unary(){
 
     if(match(BANG, MINUS)){
         Token op = previous();
-        // If we find "!" | "-" ; parse the expressions on the right recursively
-        std::shared_ptr<Expr> right = unary();
-        return std::make_shared<Unary>(std::move(op),right);
+        // If we find "!" | "-" ; parse the operand on the right, binding tighter than any infix operator
+        const Expr* right = parsePrecedence(PREC_UNARY);
+        if(right == nullptr) return nullptr;
+        return node<Unary>(std::move(op),right);
     }
     
     // Else, it must be a primary expression (Thats the only option left at this level of precedence)
@@ -538,29 +547,29 @@ std::shared_ptr<Expr> Parser::unary(){
 
 //// START : Primary operators (Highest precedence) ////
 // 7) primary → NUMBER | STRING | "true" | "false" | "nil" | "(" expression ")" ;
-std::shared_ptr<Expr> Parser::primary(){
-    if(match(FALSE)) return std::make_shared<Literal>(false);
-    if(match(TRUE)) return std::make_shared<Literal>(true);
-    if(match(NIL)) return std::make_shared<Literal>(nullptr);
-    if(match(IDENTIFIER)) return std::make_shared<Variable>(previous());
+const Expr* Parser::primary(){
+    if(match(FALSE)) return node<Literal>(Value{false});
+    if(match(TRUE)) return node<Literal>(Value{true});
+    if(match(NIL)) return node<Literal>(Value{nullptr});
+    if(match(IDENTIFIER)) return node<Variable>(previous());
     if(match(NUMBER,STRING)){
-        return std::make_shared<Literal>(previous().literal);
+        return node<Literal>(tokens.literal(current-1));
     }
     // If we match a "(", we must find a ")" otherwise its an error
     if(match(LEFT_PAREN)){
         // Start recursively consuming expressions
 
-        std::shared_ptr<Expr> expr = expression();
+        const Expr* expr = expression();
         // After parsing expression, next token must be ")"
-        consume(RIGHT_PAREN, "Expect ')' after expression.");
+        if(expr == nullptr || !consume(RIGHT_PAREN, "Expect ')' after expression.")) return nullptr;
         
-        return std::make_shared<Grouping>(expr);
+        return node<Grouping>(expr);
 
     }
 
     // If no cases match till now, we are at a token that is not a part of any expression
         
 
-    throw error(peek(), "Expect expression.");
+    return error(peek(), "Expect expression.");
 
 }
\ No newline at end of file
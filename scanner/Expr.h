@@ -1,140 +1,126 @@
 #pragma once
 
-#include <any>
-#include <memory>
+#include <cstdint>
 #include <utility>  // std::move
 #include <vector>
 #include "../scanner/token.h"
-
-struct Assign;
-struct Binary;
-struct Logical;
-struct Unary;
-struct Literal;
-struct Grouping;
-struct Ternary;
-struct Variable;
-
-struct ExprVisitor {
-virtual std::any visitAssignExpr(std::shared_ptr<Assign> expr) = 0;
-virtual std::any visitBinaryExpr(std::shared_ptr<Binary> expr) = 0;
-virtual std::any visitLogicalExpr(std::shared_ptr<Logical> expr) = 0;
-virtual std::any visitUnaryExpr(std::shared_ptr<Unary> expr) = 0;
-virtual std::any visitLiteralExpr(std::shared_ptr<Literal> expr) = 0;
-virtual std::any visitGroupingExpr(std::shared_ptr<Grouping> expr) = 0;
-virtual std::any visitTernaryExpr(std::shared_ptr<Ternary> expr) = 0;
-virtual std::any visitVariableExpr(std::shared_ptr<Variable> expr) = 0;
-virtual ~ExprVisitor() = default;
+#include "../utils/value.h"
+
+enum class ExprKind : std::uint8_t {
+  Assign,
+  Binary,
+  Logical,
+  Unary,
+  Literal,
+  Grouping,
+  Ternary,
+  Variable,
 };
 
 struct Expr
 {
- virtual std::any accept(ExprVisitor& visitor) = 0;
+  const ExprKind kind;
+
+protected:
+  explicit Expr(ExprKind kind) : kind(kind) {}
 };
 
-struct Assign: Expr, public std::enable_shared_from_this<Assign> {
-  Assign(Token name, std::shared_ptr<Expr> value)
-  : name{std::move(name)}, value{std::move(value)}
+struct Assign: Expr {
+  Assign(Token name, const Expr* value)
+  : Expr{ExprKind::Assign}, name{std::move(name)}, value{std::move(value)}
   {}
 
-  std::any accept(ExprVisitor& visitor) override {
-    return visitor.visitAssignExpr(shared_from_this());
-  }
-
   const Token name;
-  const std::shared_ptr<Expr> value;
+  const Expr* const value;
 };
 
-struct Binary: Expr, public std::enable_shared_from_this<Binary> {
-  Binary(std::shared_ptr<Expr> left, Token op, std::shared_ptr<Expr> right)
-  : left{std::move(left)}, op{std::move(op)}, right{std::move(right)}
+struct Binary: Expr {
+  Binary(const Expr* left, Token op, const Expr* right)
+  : Expr{ExprKind::Binary}, left{std::move(left)}, op{std::move(op)}, right{std::move(right)}
   {}
 
-  std::any accept(ExprVisitor& visitor) override {
-    return visitor.visitBinaryExpr(shared_from_this());
-  }
-
-  const std::shared_ptr<Expr> left;
+  const Expr* const left;
   const Token op;
-  const std::shared_ptr<Expr> right;
+  const Expr* const right;
 };
 
-struct Logical: Expr, public std::enable_shared_from_this<Logical> {
-  Logical(std::shared_ptr<Expr> left, Token op, std::shared_ptr<Expr> right)
-  : left{std::move(left)}, op{std::move(op)}, right{std::move(right)}
+struct Logical: Expr {
+  Logical(const Expr* left, Token op, const Expr* right)
+  : Expr{ExprKind::Logical}, left{std::move(left)}, op{std::move(op)}, right{std::move(right)}
   {}
 
-  std::any accept(ExprVisitor& visitor) override {
-    return visitor.visitLogicalExpr(shared_from_this());
-  }
-
-  const std::shared_ptr<Expr> left;
+  const Expr* const left;
   const Token op;
-  const std::shared_ptr<Expr> right;
+  const Expr* const right;
 };
 
-struct Unary: Expr, public std::enable_shared_from_this<Unary> {
-  Unary(Token op, std::shared_ptr<Expr> right)
-  : op{std::move(op)}, right{std::move(right)}
+struct Unary: Expr {
+  Unary(Token op, const Expr* right)
+  : Expr{ExprKind::Unary}, op{std::move(op)}, right{std::move(right)}
   {}
 
-  std::any accept(ExprVisitor& visitor) override {
-    return visitor.visitUnaryExpr(shared_from_this());
-  }
-
   const Token op;
-  const std::shared_ptr<Expr> right;
+  const Expr* const right;
 };
 
-struct Literal: Expr, public std::enable_shared_from_this<Literal> {
-  Literal(std::any value)
-  : value{std::move(value)}
+struct Literal: Expr {
+  Literal(Value value)
+  : Expr{ExprKind::Literal}, value{std::move(value)}
   {}
 
-  std::any accept(ExprVisitor& visitor) override {
-    return visitor.visitLiteralExpr(shared_from_this());
-  }
-
-  const std::any value;
+  const Value value;
 };
 
-struct Grouping: Expr, public std::enable_shared_from_this<Grouping> {
-  Grouping(std::shared_ptr<Expr> expression)
-  : expression{std::move(expression)}
+struct Grouping: Expr {
+  Grouping(const Expr* expression)
+  : Expr{ExprKind::Grouping}, expression{std::move(expression)}
   {}
 
-  std::any accept(ExprVisitor& visitor) override {
-    return visitor.visitGroupingExpr(shared_from_this());
-  }
-
-  const std::shared_ptr<Expr> expression;
+  const Expr* const expression;
 };
 
-struct Ternary: Expr, public std::enable_shared_from_this<Ternary> {
-  Ternary(std::shared_ptr<Expr> left, Token leftOp, std::shared_ptr<Expr> middle,  Token middleOp, std::shared_ptr<Expr> right)
-  : left{std::move(left)}, middle{std::move(middle)}, right{std::move(right)}, leftOp{std::move(leftOp)}, middleOp{std::move(middleOp)}
+struct Ternary: Expr {
+  Ternary(const Expr* left, Token leftOp, const Expr* middle, Token middleOp, const Expr* right)
+  : Expr{ExprKind::Ternary}, left{std::move(left)}, leftOp{std::move(leftOp)}, middle{std::move(middle)}, middleOp{std::move(middleOp)}, right{std::move(right)}
   {}
 
-  std::any accept(ExprVisitor& visitor) override {
-    return visitor.visitTernaryExpr(shared_from_this());
-  }
-
-  const std::shared_ptr<Expr> left;
-  const std::shared_ptr<Expr> middle;
-  const std::shared_ptr<Expr> right;
+  const Expr* const left;
   const Token leftOp;
+  const Expr* const middle;
   const Token middleOp;
+  const Expr* const right;
 };
 
-struct Variable: Expr, public std::enable_shared_from_this<Variable> {
+struct Variable: Expr {
   Variable(Token name)
-  : name{std::move(name)}
+  : Expr{ExprKind::Variable}, name{std::move(name)}
   {}
 
-  std::any accept(ExprVisitor& visitor) override {
-    return visitor.visitVariableExpr(shared_from_this());
-  }
-
   const Token name;
 };
 
+template <class Derived, class R>
+struct ExprVisitor {
+  R visit(const Expr* expr) {
+    Derived& self = static_cast<Derived&>(*this);
+    switch (expr->kind) {
+      case ExprKind::Assign:
+        return self.visitAssignExpr(static_cast<const Assign*>(expr));
+      case ExprKind::Binary:
+        return self.visitBinaryExpr(static_cast<const Binary*>(expr));
+      case ExprKind::Logical:
+        return self.visitLogicalExpr(static_cast<const Logical*>(expr));
+      case ExprKind::Unary:
+        return self.visitUnaryExpr(static_cast<const Unary*>(expr));
+      case ExprKind::Literal:
+        return self.visitLiteralExpr(static_cast<const Literal*>(expr));
+      case ExprKind::Grouping:
+        return self.visitGroupingExpr(static_cast<const Grouping*>(expr));
+      case ExprKind::Ternary:
+        return self.visitTernaryExpr(static_cast<const Ternary*>(expr));
+      default:
+      case ExprKind::Variable:
+        return self.visitVariableExpr(static_cast<const Variable*>(expr));
+    }
+  }
+};
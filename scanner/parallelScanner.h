@@ -0,0 +1,128 @@
+#pragma once
+
+#include<algorithm>
+#include<string_view>
+#include<thread>
+#include<vector>
+#include"../utils/error.h"
+#include"scanner.h"
+#include"simd.h"
+#include"tokenBuffer.h"
+
+/*
+Scans very large sources on several threads and produces exactly the TokenBuffer (and errors) the serial Scanner would.
+
+    1) A cheap pre-pass walks the source with only 4 states (code, string, line comment, block comment)
+       and picks one split point per chunk : just after a newline that is in plain code.
+       A newline in code is never part of a token, so no token, string or comment straddles a split.
+    2) Each chunk gets its own Scanner (one thread per chunk), counting lines from 1 and holding back its errors.
+    3) Chunks are concatenated in order, shifting each one's lines by the newlines of the chunks before it,
+       and the held back errors are reported in the same (source) order the serial scanner would use.
+
+Small inputs just go through the serial Scanner.
+*/
+class ParallelScanner{
+
+public:
+    static constexpr std::size_t minParallelSize = 4 << 20;  // below this threads cost more than they save
+    static constexpr std::size_t minChunkSize = 1 << 20;
+
+    ParallelScanner(std::string_view source, unsigned threads = std::thread::hardware_concurrency())
+    : source(source), threads(std::max(threads, 1u))
+    {}
+
+    TokenBuffer scanTokens(){
+        std::size_t chunks = std::min<std::size_t>(threads, source.size() / minChunkSize);
+        if(source.size() < minParallelSize || chunks < 2){
+            return Scanner(source).scanTokens();
+        }
+
+        // One vectorized pass over the whole buffer, the chunk scanners don't repeat it
+        Scanner::checkEncoding(source);
+
+        std::vector<std::size_t> bounds = splitPoints(chunks);
+        chunks = bounds.size() - 1;
+
+        std::vector<TokenBuffer> results(chunks, TokenBuffer(source));
+        std::vector<std::vector<Diagnostic>> errors(chunks);
+        std::vector<int> lastLines(chunks);
+
+        auto scanOne = [&](std::size_t i){
+            Scanner scanner(source, bounds[i], bounds[i + 1], true);
+            results[i] = scanner.scanChunk();
+            errors[i] = std::move(scanner.diagnostics);
+            lastLines[i] = scanner.lastLine();
+        };
+
+        std::vector<std::thread> workers;
+        for(std::size_t i = 1; i < chunks; ++i) workers.emplace_back(scanOne, i);
+        scanOne(0);
+        for(std::thread& worker : workers) worker.join();
+
+        // Stitch the chunks together in order and fix up their line numbers
+        std::size_t total = 1;
+        for(const TokenBuffer& chunk : results) total += chunk.size();
+
+        TokenBuffer tokens(source);
+        tokens.reserve(total);
+        int lineOffset = 0;
+        for(std::size_t i = 0; i < chunks; ++i){
+            tokens.append(results[i], lineOffset);
+            for(const Diagnostic& diagnostic : errors[i]){
+                error(diagnostic.line + lineOffset, diagnostic.message);
+            }
+            lineOffset += lastLines[i] - 1;
+        }
+
+        tokens.push(END_OF_FILE, source.size(), 0, lineOffset + 1);
+        return tokens;
+    }
+
+private:
+    const std::string_view source;
+    const unsigned threads;
+
+    // Returns chunk boundaries [0, s1, s2, ..., size]. Fewer chunks come back if the source
+    // ends inside a string or comment before every target is reached
+    std::vector<std::size_t> splitPoints(std::size_t chunks){
+        const char* begin = source.data();
+        const char* end = begin + source.size();
+        const char* p = begin;
+
+        std::vector<std::size_t> bounds{0};
+        int unused = 0;
+
+        for(std::size_t i = 1; i < chunks && p < end; ++i){
+            const char* target = begin + source.size() * i / chunks;
+
+            // Walk in code state until we are past the target and sitting on a newline
+            while(p < end){
+                char c = *p;
+                if(c == '\n' && p >= target) break;
+
+                if(c == '"'){
+                    p = simd::findQuote(p + 1, end, unused);
+                    if(p < end) ++p;  // closing quote
+                }
+                else if(c == '/' && p + 1 < end && p[1] == '/'){
+                    p = simd::findNewline(p + 2, end);
+                }
+                else if(c == '/' && p + 1 < end && p[1] == '*'){
+                    // Same search as the scanner : from after "/*" to the first "*/"
+                    p = simd::findStar(p + 2, end, unused);
+                    while(p + 1 < end && p[1] != '/') p = simd::findStar(p + 1, end, unused);
+                    p = p + 1 < end ? p + 2 : end;
+                }
+                else ++p;
+            }
+
+            if(p < end){
+                ++p;  // split right after the newline
+                bounds.push_back(p - begin);
+            }
+        }
+
+        bounds.push_back(source.size());
+        return bounds;
+    }
+};
@@ -1,43 +1,95 @@
 #pragma once
 
+#include<algorithm>
+#include<charconv>   // std::from_chars
+#include<cstdint>
 #include<iostream>
 #include<string>
+#include<string_view>
 #include<vector>
 #include<utility>
-#include<unordered_map>
 #include"../utils/error.h"
 #include"token.h"
+#include"tokenBuffer.h"
+#include"simd.h"
+#include"utf8.h"
 
 class Scanner{
 
 private:
-    static const std::unordered_map<std::string,TokenType> keywords;
-    const std::string source;
-    std::vector<Token> tokens;
+    // View of the caller's source buffer. Token lexemes point into it, so it must outlive the tokens
+    const std::string_view source;
+    TokenBuffer tokens;
     int start = 0;
     int current = 0;
+    int end = 0;    // one past the last character this scanner looks at
     int line = 1;
+    // When set, errors are collected in `diagnostics` instead of being reported right away
+    const bool deferErrors = false;
 
-public:
-    Scanner(std::string source) : source(source) {}
-
-    // Main function to parse the file and store tokens
-    std::vector<Token> scanTokens(){
+    void scanAll(){
         // Read chars and populate the tokens variable
         while(!isAtEnd()){
             start = current;
             scanToken();
-        }      
-        
+        }
+    }
+
+public:
+    std::vector<Diagnostic> diagnostics;
+    // How many tokens had been scanned when each of `diagnostics` was found (places them between tokens)
+    std::vector<std::uint32_t> diagnosticTokens;
+
+    Scanner(std::string_view source) : source(source), tokens(source), end(static_cast<int>(source.size())) {}
+
+    // Scan only source[begin, end). Offsets stay relative to the whole buffer, lines are counted from 1
+    Scanner(std::string_view source, std::size_t begin, std::size_t end, bool deferErrors)
+    : source(source), tokens(source), current(static_cast<int>(begin)), end(static_cast<int>(end)), deferErrors(deferErrors)
+    {}
+
+    // Main function to parse the file and store tokens
+    TokenBuffer scanTokens(){
+        checkEncoding(source);
+        scanAll();
+
         // Add an EOF token at the end of file
-        Token* last = new Token(END_OF_FILE,"",nullptr,line);
-        tokens.push_back(*last);
-        return tokens;
+        tokens.push(END_OF_FILE,end,0,line);
+        return std::move(tokens);
+    }
+
+    // Tokens of a chunk (no EOF), see ParallelScanner
+    TokenBuffer scanChunk(){
+        scanAll();
+        return std::move(tokens);
+    }
+
+    // Sources must be UTF-8. Reports the first invalid byte and returns false if they aren't
+    // (scanning still goes on so every other error gets reported too)
+    static bool checkEncoding(std::string_view source){
+        std::size_t bad = validateUtf8(source);
+        if(bad == std::string_view::npos) return true;
+
+        int badLine = 1 + static_cast<int>(std::count(source.begin(), source.begin() + bad, '\n'));
+        ::error(badLine, "Invalid UTF-8 encoding.");
+        return false;
+    }
+
+    // Line the scanner stopped on (1 + newlines scanned)
+    int lastLine() const {
+        return line;
+    }
+
+    void error(int line, std::string message){
+        if(deferErrors){
+            diagnostics.push_back({line, "", std::move(message)});
+            diagnosticTokens.push_back(static_cast<std::uint32_t>(tokens.size()));
+        }
+        else ::error(line, message);
     }
 
     // Helper : check end of file
     bool isAtEnd(){
-        return current >= source.size();
+        return current >= end;
     }
     
     // Helper : consume current character and move ahead
@@ -45,16 +97,11 @@ public:
         return source[current++];
     }
     
-    // Helper : parse the current token
+    // Helper : record the current token as an offset/length into the source
     void addToken(TokenType type){
-        addToken(type,nullptr);
+        tokens.push(type, start, current - start, line);
     }
 
-    void addToken(TokenType type, std::any literal){
-        std::string text = source.substr(start,current - start);
-        tokens.push_back(Token(type, text,literal, line));
-    }
-    
     // Helper : Match next character of lexeme
     bool match(char expected){
         if(isAtEnd()) return false;
@@ -63,6 +110,19 @@ public:
         return true;
     }
 
+    // Helpers for the vectorized kernels (simd.h) which work on raw pointers
+    const char* cursor(){
+        return source.data() + current;
+    }
+
+    const char* limit(){
+        return source.data() + end;
+    }
+
+    void moveTo(const char* p){
+        current = static_cast<int>(p - source.data());
+    }
+
     // Helper : Look ahead by 1 character
     char peek(){
         if(isAtEnd()) return '\0';
@@ -71,7 +131,7 @@ public:
     
     // Helper : Look ahead by 2 characters
     char peekNext(){
-        if(current + 1 >= source.size()) return '\0';
+        if(current + 1 >= end) return '\0';
 
         return source[current+1];
     }
@@ -79,23 +139,19 @@ public:
     // Process string literals
     void string(){
         // Keep consuming characters until we reach the end of string literal eg. "abc" or if we reach the end of file.
-        while(peek() != '"' && !isAtEnd()){
-            if(peek() == '\n'){
-                ++line;
-            }
-            advance();
-        }
+        // The kernel jumps straight to the closing '"' and counts the newlines it skips
+        moveTo(simd::findQuote(cursor(), limit(), line));
 
         // If file has ended already and we did not encounter closing '"' - error
         if(isAtEnd()){
             error(line, "Unterminated string.");
+            return;
         }
 
         advance(); // One more time to consume the closing '"'
 
-        std::string value = source.substr(start+1,current - 2 - start);
-
-        addToken(STRING,value);
+        // The value is the lexeme without its quotes, interned when the parser materializes the token
+        addToken(STRING);
 
     }
 
@@ -111,35 +167,120 @@ public:
             while(isDigit(peek())) advance();
         }
 
-        // Convert the string to "double"
-        addToken(NUMBER,std::stod(source.substr(start,current - start)));
+        // Convert the lexeme to "double" in place
+        tokens.pushNumber(start, current - start, line, parseNumber(source.substr(start,current - start)));
+    }
+
+    // Lexeme → double without a temporary string, and locale independent unlike std::stod
+    // Results are bit-identical to std::stod : both paths below are correctly rounded
+    static double parseNumber(std::string_view text){
+        // Fast path (Clinger) : up to 15 significant digits fit exactly in a double's 53 bit mantissa,
+        // and 10^0..10^22 are exact doubles, so one division gives the correctly rounded value
+        static constexpr double powersOf10[] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+        };
+
+        std::uint64_t mantissa = 0;
+        int digits = 0;
+        int fraction = -1; // digits after the '.', -1 while we haven't seen one
+        for(char c : text){
+            if(c == '.'){
+                fraction = 0;
+                continue;
+            }
+            mantissa = mantissa * 10 + (c - '0');
+            ++digits;
+            if(fraction >= 0) ++fraction;
+        }
+
+        if(digits <= 15){
+            double value = static_cast<double>(mantissa);
+            return fraction > 0 ? value / powersOf10[fraction] : value;
+        }
+
+        // Long literals go through the standard correctly rounded conversion
+        double value = 0;
+        std::from_chars(text.data(), text.data() + text.size(), value);
+        return value;
     }
     // Process identifiers and keywords
     void identifier(){
-        while(isAlphaNumeric(peek())) {
-            advance();
-        }
+        // ASCII runs go through the kernel, non-ASCII characters are checked against XID_Continue
+        while(true){
+            moveTo(simd::identifierEnd(cursor(), limit()));
+            if(isAtEnd() || static_cast<unsigned char>(peek()) < 0x80) break;
 
-        std::string text = source.substr(start,current-start);
-        TokenType type;
-        // Substring is a keyword
-        if(keywords.find(text) != keywords.end()){
-            // addToken(keywords[text]); // Cannot use [] in const map because if key is not found, it tries to add it in map
-            type = keywords.at(text);
+            std::uint32_t cp;
+            int length = decodeUtf8(cursor(), limit(), cp);
+            if(length == 0 || !isXidContinue(cp)) break;
+            moveTo(cursor() + length);
         }
-        // Substring is an identifier
-        else type = IDENTIFIER;
-        
-        if(type == TRUE) {
-            addToken(type,true);
+
+        // Substring is a keyword or an identifier
+        TokenType type = keywordType(source.substr(start,current-start));
+
+        // TRUE/FALSE payloads are implied by the type, so nothing extra is stored
+        addToken(type);
+
+    }
+    
+    // Identifiers may start with any XID_Start character (keywords are all ASCII)
+    void unicode(){
+        std::uint32_t cp;
+        int length = decodeUtf8(source.data() + start, limit(), cp);
+        if(length == 0){
+            error(line, "Unexpected character.");
+            return;
         }
-        else if(type == FALSE){
-            addToken(type,false);
+
+        moveTo(source.data() + start + length);
+        if(isXidStart(cp)) identifier();
+        else error(line, "Unexpected character.");
+    }
+
+    // Keyword lookup straight on the lexeme view : no allocation and no hashing
+    // Switch on the length and first character, which leaves at most one candidate to compare against
+    static constexpr TokenType keywordType(std::string_view text){
+        auto is = [text](std::string_view keyword, TokenType type){ return text == keyword ? type : IDENTIFIER; };
+
+        switch(text.size()){
+            case 2:
+                switch(text[0]){
+                    case 'i': return is("if", IF);
+                    case 'o': return is("or", OR);
+                }
+                break;
+            case 3:
+                switch(text[0]){
+                    case 'a': return is("and", AND);
+                    case 'f': return text[1] == 'o' ? is("for", FOR) : is("fun", FUN);
+                    case 'n': return is("nil", NIL);
+                    case 'v': return is("var", VAR);
+                }
+                break;
+            case 4:
+                switch(text[0]){
+                    case 'e': return is("else", ELSE);
+                    case 't': return text[1] == 'h' ? is("this", THIS) : is("true", TRUE);
+                }
+                break;
+            case 5:
+                switch(text[0]){
+                    case 'c': return is("class", CLASS);
+                    case 'f': return is("false", FALSE);
+                    case 'p': return is("print", PRINT);
+                    case 's': return is("super", SUPER);
+                    case 'w': return is("while", WHILE);
+                }
+                break;
+            case 6:
+                return is("return", RETURN);
         }
-        else addToken(type);
-        
+
+        return IDENTIFIER;
     }
-    
+
     // Helper : Check if char a digit
     bool isDigit(char c){
         return (c >= '0' && c <= '9');
@@ -178,31 +319,32 @@ public:
             case '/' : 
                 // If its a comment : Just skip the following characters
                 if(match('/')) {
-                    while( peek() != '\n' && !isAtEnd()) {
-                        advance();
-                    }
+                    moveTo(simd::findNewline(cursor(), limit()));
                 }
                 // If multiline block comment  ( /* ... */ )
                 else if(match('*')) {
-                    while( !isAtEnd() && peek() != '*' && peekNext() != '/' ){
-                        if(peek() == '\n') ++line;
-                        advance();
+                    // Jump from '*' to '*' until one is followed by the closing '/'
+                    const char* p = simd::findStar(cursor(), limit(), line);
+                    while(p + 1 < limit() && p[1] != '/'){
+                        p = simd::findStar(p + 1, limit(), line);
                     }
-                    if(isAtEnd()){
+                    if(p + 1 >= limit()){
+                        moveTo(limit());
                         error(line, "Unterminated block comment.");
+                        break;
                     }
 
                     // To consume closing "*/"
-                    advance(); 
-                    advance();
+                    moveTo(p + 2);
                 }
                 else addToken(SLASH); 
                 break;
             /// Skip over meaningless characters ///
+            // Skip over white spaces, a whole run at a time
+            case '\n' : line++; [[fallthrough]];
             case ' ' :
             case '\r' :
-            case '\t' : break; // Skip over white spaces
-            case '\n' : line++; break;
+            case '\t' : moveTo(simd::skipWhitespace(cursor(), limit(), line)); break;
             /// Double character lexemes ///
             case '=' : addToken(match('=') ? EQUAL_EQUAL : EQUAL); break;
             case '!' : addToken(match('=') ? BANG_EQUAL : BANG); break;
@@ -219,6 +361,10 @@ public:
                 else if(isAlpha(c)){
                     identifier();
                 }
+                // Non-ASCII : a Unicode identifier or an error for the whole character
+                else if(static_cast<unsigned char>(c) >= 0x80){
+                    unicode();
+                }
 
                 else error(line,"Unexpected character.");
                 break;        
@@ -229,21 +375,14 @@ public:
     
 };
 
-const std::unordered_map<std::string,TokenType> Scanner::keywords = {
-    {"and",    AND},
-    {"class",  CLASS},
-    {"else",   ELSE},
-    {"false",  FALSE},
-    {"for",    FOR},
-    {"fun",    FUN},
-    {"if",     IF},
-    {"nil",    NIL},
-    {"or",     OR},
-    {"print",  PRINT},
-    {"return", RETURN},
-    {"super",  SUPER},
-    {"this",   THIS},
-    {"true",   TRUE},
-    {"var",    VAR},
-    {"while",  WHILE}
-};
\ No newline at end of file
+// All 16 keywords are checked at compile time
+static_assert(Scanner::keywordType("and") == AND && Scanner::keywordType("class") == CLASS &&
+              Scanner::keywordType("else") == ELSE && Scanner::keywordType("false") == FALSE &&
+              Scanner::keywordType("for") == FOR && Scanner::keywordType("fun") == FUN &&
+              Scanner::keywordType("if") == IF && Scanner::keywordType("nil") == NIL &&
+              Scanner::keywordType("or") == OR && Scanner::keywordType("print") == PRINT &&
+              Scanner::keywordType("return") == RETURN && Scanner::keywordType("super") == SUPER &&
+              Scanner::keywordType("this") == THIS && Scanner::keywordType("true") == TRUE &&
+              Scanner::keywordType("var") == VAR && Scanner::keywordType("while") == WHILE);
+static_assert(Scanner::keywordType("fan") == IDENTIFIER && Scanner::keywordType("thus") == IDENTIFIER &&
+              Scanner::keywordType("whiles") == IDENTIFIER && Scanner::keywordType("") == IDENTIFIER);
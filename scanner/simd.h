@@ -0,0 +1,187 @@
+#pragma once
+
+#include<cstdint>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define LOX_SIMD_X86 1
+#include<immintrin.h>
+#endif
+
+/*
+Vectorized helpers for the scanner's hot loops. Each kernel takes [p, end) and returns a pointer
+to the first byte it stops on (or end). Kernels that can run over newlines add them to `lines`,
+so the scanner's line counter stays correct without looking at every byte.
+
+    - skipWhitespace : stops at the first byte that is not ' ', '\r', '\t' or '\n'
+    - findNewline    : stops at '\n' (line comments)
+    - findQuote      : stops at '"' (string bodies)
+    - findStar       : stops at '*' (block comments, the caller checks for the '/')
+    - identifierEnd  : stops at the first byte that is not [A-Za-z0-9_]
+    - firstNonAscii  : stops at the first byte >= 0x80 (UTF-8 validation skips pure ASCII runs with it)
+
+On x86 the AVX2 (32 bytes) or SSE2 (16 bytes) version is picked once at runtime, everything
+else gets the plain scalar loops.
+*/
+namespace simd {
+
+enum Kernel { WHITESPACE, NEWLINE, QUOTE, STAR, IDENTIFIER, NON_ASCII };
+
+// Scalar reference version, also used for the tail that doesn't fill a vector
+template <Kernel K>
+inline bool stopsAt(char c){
+    if constexpr (K == WHITESPACE) return !(c == ' ' || c == '\r' || c == '\t' || c == '\n');
+    if constexpr (K == NEWLINE) return c == '\n';
+    if constexpr (K == QUOTE) return c == '"';
+    if constexpr (K == STAR) return c == '*';
+    if constexpr (K == IDENTIFIER) return !((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_');
+    if constexpr (K == NON_ASCII) return static_cast<unsigned char>(c) >= 0x80;
+    return true;
+}
+
+template <Kernel K>
+inline const char* scanScalar(const char* p, const char* end, int& lines){
+    while(p < end && !stopsAt<K>(*p)){
+        if(*p == '\n') ++lines;
+        ++p;
+    }
+    return p;
+}
+
+#ifdef LOX_SIMD_X86
+
+// Bitmask of the bytes the kernel stops on, and of the newlines (only needed when the kernel can skip over them)
+template <Kernel K>
+inline std::uint32_t stopMaskSse2(__m128i v, std::uint32_t& newlines){
+    __m128i nl = _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'));
+    newlines = static_cast<std::uint32_t>(_mm_movemask_epi8(nl));
+    if constexpr (K == WHITESPACE) {
+        __m128i ws = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+                                  _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\r')), nl));
+        return ~static_cast<std::uint32_t>(_mm_movemask_epi8(ws)) & 0xFFFFu;
+    }
+    if constexpr (K == NEWLINE) return newlines;
+    if constexpr (K == QUOTE) return static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('"'))));
+    if constexpr (K == STAR) return static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('*'))));
+    if constexpr (K == IDENTIFIER) {
+        // All the accepted ranges are below 0x80, so signed compares are enough (non-ASCII bytes are negative)
+        auto inRange = [](__m128i x, char lo, char hi){
+            return _mm_and_si128(_mm_cmpgt_epi8(x, _mm_set1_epi8(lo - 1)), _mm_cmpgt_epi8(_mm_set1_epi8(hi + 1), x));
+        };
+        __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20)); // folds 'A'-'Z' onto 'a'-'z'
+        __m128i ok = _mm_or_si128(_mm_or_si128(inRange(lower, 'a', 'z'), inRange(v, '0', '9')),
+                                  _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+        return ~static_cast<std::uint32_t>(_mm_movemask_epi8(ok)) & 0xFFFFu;
+    }
+    if constexpr (K == NON_ASCII) return static_cast<std::uint32_t>(_mm_movemask_epi8(v));  // the sign bits
+    return 0xFFFFu;
+}
+
+template <Kernel K>
+inline const char* scanSse2(const char* p, const char* end, int& lines){
+    while(end - p >= 16){
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        std::uint32_t newlines;
+        std::uint32_t stop = stopMaskSse2<K>(v, newlines);
+        if(stop){
+            int index = __builtin_ctz(stop);
+            if constexpr (K != NEWLINE) lines += __builtin_popcount(newlines & ((1u << index) - 1));
+            return p + index;
+        }
+        if constexpr (K != NEWLINE) lines += __builtin_popcount(newlines);
+        p += 16;
+    }
+    return scanScalar<K>(p, end, lines);
+}
+
+template <Kernel K>
+__attribute__((target("avx2")))
+inline std::uint32_t stopMaskAvx2(__m256i v, std::uint32_t& newlines){
+    __m256i nl = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'));
+    newlines = static_cast<std::uint32_t>(_mm256_movemask_epi8(nl));
+    if constexpr (K == WHITESPACE) {
+        __m256i ws = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))),
+                                     _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')), nl));
+        return ~static_cast<std::uint32_t>(_mm256_movemask_epi8(ws));
+    }
+    if constexpr (K == NEWLINE) return newlines;
+    if constexpr (K == QUOTE) return static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"'))));
+    if constexpr (K == STAR) return static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('*'))));
+    if constexpr (K == IDENTIFIER) {
+        __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+        __m256i letter = _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower));
+        __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));
+        __m256i ok = _mm256_or_si256(_mm256_or_si256(letter, digit), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_')));
+        return ~static_cast<std::uint32_t>(_mm256_movemask_epi8(ok));
+    }
+    if constexpr (K == NON_ASCII) return static_cast<std::uint32_t>(_mm256_movemask_epi8(v));
+    return 0xFFFFFFFFu;
+}
+
+template <Kernel K>
+__attribute__((target("avx2")))
+const char* scanAvx2(const char* p, const char* end, int& lines){
+    while(end - p >= 32){
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        std::uint32_t newlines;
+        std::uint32_t stop = stopMaskAvx2<K>(v, newlines);
+        if(stop){
+            int index = __builtin_ctz(stop);
+            if constexpr (K != NEWLINE) lines += __builtin_popcount(newlines & ((1u << index) - 1));
+            return p + index;
+        }
+        if constexpr (K != NEWLINE) lines += __builtin_popcount(newlines);
+        p += 32;
+    }
+    return scanSse2<K>(p, end, lines);
+}
+
+#endif
+
+using KernelFn = const char* (*)(const char*, const char*, int&);
+
+// Pick the widest implementation this CPU supports, once per kernel
+template <Kernel K>
+inline KernelFn select(){
+#ifdef LOX_SIMD_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) return &scanAvx2<K>;
+    return &scanSse2<K>;
+#else
+    return &scanScalar<K>;
+#endif
+}
+
+template <Kernel K>
+inline const char* scan(const char* p, const char* end, int& lines){
+    static const KernelFn fn = select<K>();
+    return fn(p, end, lines);
+}
+
+inline const char* skipWhitespace(const char* p, const char* end, int& lines){
+    return scan<WHITESPACE>(p, end, lines);
+}
+
+inline const char* findNewline(const char* p, const char* end){
+    int unused = 0;
+    return scan<NEWLINE>(p, end, unused);
+}
+
+inline const char* findQuote(const char* p, const char* end, int& lines){
+    return scan<QUOTE>(p, end, lines);
+}
+
+inline const char* findStar(const char* p, const char* end, int& lines){
+    return scan<STAR>(p, end, lines);
+}
+
+inline const char* identifierEnd(const char* p, const char* end){
+    int unused = 0;
+    return scan<IDENTIFIER>(p, end, unused);
+}
+
+inline const char* firstNonAscii(const char* p, const char* end){
+    int unused = 0;
+    return scan<NON_ASCII>(p, end, unused);
+}
+
+} // namespace simd
@@ -1,9 +1,11 @@
 #pragma once
 
 #include<string>
-#include<any>
+#include<string_view>
 #include"../utils/error.h"
+#include"../utils/interner.h"
 #include"../utils/tokenType.h"
+#include"../utils/value.h"
 #include<utility>
 /*
 This class will process take in the parsed string and generate tokens
@@ -13,15 +15,21 @@ class Token{
 
 public:
     const TokenType type;
-    const std::string lexeme;
+    // lexeme is a view into the scanned source buffer (no copy per token)
+    // The buffer must outlive every token (and AST node) made from it
+    const std::string_view lexeme;
     // literal here has the actual value of the parsed token
-    // It can be any type : NUMERIC, STRING etc so we store it as std::any type and process it later by checking type
-    const std::any literal;
+    // It can be any type : NUMERIC, STRING etc so we store it as a Value (variant) and process it later by checking type
+    // STRING literals are interned (Symbol) so copying the value around never copies the text
+    const Value literal;
     const int line;
+    // Interned name for IDENTIFIER tokens : environments key on it instead of hashing the lexeme
+    const Symbol symbol;
 
     // std::move - transfers resources from the given variable to another l-value
     // This reduces the overhead of creating copies if the variable being copied is not be used anymore
-    Token(TokenType type, std::string lexeme, std::any literal, const int line) : type(type), lexeme(std::move(lexeme)), literal(literal), line(line) {};
+    Token(TokenType type, std::string_view lexeme, Value literal, const int line, Symbol symbol = {})
+    : type(type), lexeme(lexeme), literal(std::move(literal)), line(line), symbol(symbol) {};
 
     std::string toString(){
         
@@ -32,10 +40,10 @@ public:
             literal_text = lexeme;
             break;
         case (STRING):
-            literal_text = std::any_cast<std::string>(literal);
+            literal_text = lexeme.substr(1, lexeme.size() - 2);
             break;
         case (NUMBER):
-            literal_text = std::to_string(std::any_cast<double>(literal));
+            literal_text = std::to_string(std::get<double>(literal));
             break;
         case (TRUE):
             literal_text = "true";
@@ -47,6 +55,6 @@ public:
             literal_text = "nil";
         }
         // Handle type of literal before returning
-        return ::toString(type) + " " + lexeme + " " + literal_text;
+        return ::toString(type) + " " + std::string(lexeme) + " " + literal_text;
     }
 };
\ No newline at end of file
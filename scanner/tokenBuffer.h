@@ -0,0 +1,130 @@
+#pragma once
+
+#include<algorithm>
+#include<cstdint>
+#include<string_view>
+#include<vector>
+#include"token.h"
+
+/*
+Packed (struct-of-arrays) storage for the scanner output, instead of a std::vector<Token>
+    - types   : one byte per token
+    - offsets : start of the lexeme in the source buffer
+    - lengths : length of the lexeme
+    - lines   : run-length table, one entry every time the line changes (tokens on a line share it)
+    - numbers : side table for NUMBER payloads, keyed by token index
+
+That is ~9-10 bytes per token against ~64 for a Token holding a std::string and a std::any.
+A full Token is only materialized (cheaply, it holds a view) when the parser needs one, eg. to store in an AST node.
+The source buffer must outlive the buffer and every token made from it.
+*/
+class TokenBuffer{
+
+public:
+    TokenBuffer(std::string_view source) : source(source) {}
+
+    void push(TokenType type, std::uint32_t offset, std::uint32_t length, int line){
+        if(lineRuns.empty() || lineRuns.back().line != line){
+            lineRuns.push_back({static_cast<std::uint32_t>(types.size()), line});
+        }
+        types.push_back(type);
+        offsets.push_back(offset);
+        lengths.push_back(length);
+    }
+
+    void pushNumber(std::uint32_t offset, std::uint32_t length, int line, double value){
+        numberTokens.push_back(static_cast<std::uint32_t>(types.size()));
+        numbers.push_back(value);
+        push(NUMBER, offset, length, line);
+    }
+
+    // Append the tokens of a chunk scanned from the same source, shifting its lines by lineOffset
+    void append(const TokenBuffer& chunk, int lineOffset){
+        std::uint32_t base = static_cast<std::uint32_t>(types.size());
+
+        types.insert(types.end(), chunk.types.begin(), chunk.types.end());
+        offsets.insert(offsets.end(), chunk.offsets.begin(), chunk.offsets.end());
+        lengths.insert(lengths.end(), chunk.lengths.begin(), chunk.lengths.end());
+        for(const LineRun& run : chunk.lineRuns){
+            if(lineRuns.empty() || lineRuns.back().line != run.line + lineOffset){
+                lineRuns.push_back({run.first + base, run.line + lineOffset});
+            }
+        }
+        for(std::uint32_t index : chunk.numberTokens) numberTokens.push_back(index + base);
+        numbers.insert(numbers.end(), chunk.numbers.begin(), chunk.numbers.end());
+    }
+
+    void reserve(std::size_t count){
+        types.reserve(count);
+        offsets.reserve(count);
+        lengths.reserve(count);
+    }
+
+    std::size_t size() const {
+        return types.size();
+    }
+
+    TokenType type(std::size_t i) const {
+        return types[i];
+    }
+
+    // Where the lexeme of token i starts in the source, and how long it is
+    std::uint32_t offset(std::size_t i) const {
+        return offsets[i];
+    }
+
+    std::uint32_t length(std::size_t i) const {
+        return lengths[i];
+    }
+
+    std::string_view lexeme(std::size_t i) const {
+        return source.substr(offsets[i], lengths[i]);
+    }
+
+    // Binary search the run whose first token is at or before i
+    int line(std::size_t i) const {
+        auto it = std::upper_bound(lineRuns.begin(), lineRuns.end(), i,
+            [](std::size_t index, const LineRun& run){ return index < run.first; });
+        return std::prev(it)->line;
+    }
+
+    double number(std::size_t i) const {
+        auto it = std::lower_bound(numberTokens.begin(), numberTokens.end(), i);
+        return numbers[it - numberTokens.begin()];
+    }
+
+    // Value carried by token i. Only NUMBER/STRING/TRUE/FALSE tokens carry a literal
+    // String bodies are interned here rather than in the scanner, so the
+    // global symbol table is only touched for literals that reach the parser
+    Value literal(std::size_t i) const {
+        switch(types[i]){
+            case NUMBER: return number(i);
+            case STRING: return intern(lexeme(i).substr(1, lengths[i] - 2));
+            case TRUE:   return true;
+            case FALSE:  return false;
+            default:     return nullptr;
+        }
+    }
+
+    // Build a full Token for index i (identifiers get their interned name)
+    Token token(std::size_t i) const {
+        Symbol symbol;
+        if(types[i] == IDENTIFIER) symbol = intern(lexeme(i));
+        return Token(types[i], lexeme(i), literal(i), line(i), symbol);
+    }
+
+private:
+    std::string_view source;
+
+    struct LineRun {
+        std::uint32_t first; // index of the first token on this line
+        int line;
+    };
+
+    std::vector<TokenType> types;
+    std::vector<std::uint32_t> offsets;
+    std::vector<std::uint32_t> lengths;
+    std::vector<LineRun> lineRuns;
+    std::vector<std::uint32_t> numberTokens;
+    std::vector<double> numbers;
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+#include<cstdint>
+#include<string_view>
+#include"simd.h"
+#include"xid.h"
+
+/*
+UTF-8 support for the scanner.
+    - validateUtf8 : whole buffer check done once before scanning. ASCII runs are skipped 16/32 bytes at a time
+                     (simd::firstNonAscii), so pure ASCII sources cost one vector pass; only multi-byte
+                     sequences are decoded one by one
+    - decodeUtf8   : one code point, used for identifiers that contain non-ASCII characters
+*/
+
+// Decodes the sequence at p. Returns its length (1-4), or 0 if it is not valid UTF-8
+// (truncated, bad continuation byte, overlong form, surrogate, or above U+10FFFF)
+inline int decodeUtf8(const char* p, const char* end, std::uint32_t& cp){
+    unsigned char lead = static_cast<unsigned char>(p[0]);
+    int length;
+    std::uint32_t min;
+
+    if(lead < 0x80)      { cp = lead; return 1; }
+    else if(lead < 0xC2) return 0;  // continuation byte, or overlong 2 byte form
+    else if(lead < 0xE0) { length = 2; cp = lead & 0x1F; min = 0x80; }
+    else if(lead < 0xF0) { length = 3; cp = lead & 0x0F; min = 0x800; }
+    else if(lead < 0xF5) { length = 4; cp = lead & 0x07; min = 0x10000; }
+    else return 0;
+
+    if(end - p < length) return 0;
+
+    for(int i = 1; i < length; ++i){
+        unsigned char c = static_cast<unsigned char>(p[i]);
+        if((c & 0xC0) != 0x80) return 0;
+        cp = (cp << 6) | (c & 0x3F);
+    }
+
+    if(cp < min || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) return 0;
+    return length;
+}
+
+// Offset of the first byte that isn't part of a valid sequence, or npos if the whole buffer is valid
+inline std::size_t validateUtf8(std::string_view text){
+    const char* p = text.data();
+    const char* end = p + text.size();
+    std::uint32_t cp;
+
+    while(true){
+        p = simd::firstNonAscii(p, end);
+        if(p == end) return std::string_view::npos;
+
+        // Decode the run of multi-byte sequences until we are back to ASCII
+        while(p < end && static_cast<unsigned char>(*p) >= 0x80){
+            int length = decodeUtf8(p, end, cp);
+            if(length == 0) return p - text.data();
+            p += length;
+        }
+    }
+}
@@ -1,14 +1,16 @@
+#include<cstdint>
 #include<iostream>
 #include<sstream>
 #include<string>
+#include"../interpreter/flatAst.h"
 #include"../scanner/Expr.h"
 #include"../scanner/token.h"
-#include<type_traits>
-#include<any>
+#include"value.h"
+#include<variant>
 
-class AstPrinter : public ExprVisitor {
+class AstPrinter : public ExprVisitor<AstPrinter, std::string> {
 private:
-    // Need a multi-parameter template class - we might pass std::shared_ptr<Literal>, Unary etc any of those
+    // Need a multi-parameter template class - we might pass const Literal*, Unary* etc any of those
     template <class... E> // Expect multiple template  params (class... E)
     std::string parenthesize(std::string name, E... expr ){ // Expand the arguments E...
         
@@ -25,43 +27,81 @@ private:
     }
 
 public:
-    std::string print(std::shared_ptr<Expr> expr){
-        // return std::any_cast<std::string>(expr->accept(*this)); // *this passes a copy of current object
-        return std::any_cast<std::string>(expr->accept(*this));
+    std::string print(const Expr* expr){
+        return visit(expr);
 
     }
 
-    std::any visitTernaryExpr(std::shared_ptr<Ternary> expr) override {
-        return parenthesize(expr->leftOp.lexeme + " " + expr->middleOp.lexeme, expr->left, expr->middle, expr->right);
+    std::string visitTernaryExpr(const Ternary* expr) {
+        return parenthesize(std::string(expr->leftOp.lexeme) + " " + std::string(expr->middleOp.lexeme), expr->left, expr->middle, expr->right);
     }
 
-    std::any visitBinaryExpr(std::shared_ptr<Binary> expr) override {
-        return parenthesize(expr->op.lexeme, expr->left, expr->right);
+    std::string visitBinaryExpr(const Binary* expr) {
+        return parenthesize(std::string(expr->op.lexeme), expr->left, expr->right);
     }
 
-    std::any visitUnaryExpr(std::shared_ptr<Unary> expr) override {
-        return parenthesize(expr->op.lexeme,expr->right);
+    std::string visitUnaryExpr(const Unary* expr) {
+        return parenthesize(std::string(expr->op.lexeme),expr->right);
     }
 
-    std::any visitGroupingExpr(std::shared_ptr<Grouping> expr) override {
+    std::string visitGroupingExpr(const Grouping* expr) {
         return parenthesize("group", expr->expression);
     }
 
-    std::any visitLiteralExpr(std::shared_ptr<Literal> expr) override {
-        // We don't know the type of literal so we handle it before converting to string
-        auto& value_type = expr->value.type();
-        
-        if(value_type == typeid(nullptr)){
+    std::string visitAssignExpr(const Assign* expr) {
+        return parenthesize("= " + std::string(expr->name.lexeme), expr->value);
+    }
+
+    std::string visitLogicalExpr(const Logical* expr) {
+        return parenthesize(std::string(expr->op.lexeme), expr->left, expr->right);
+    }
+
+    std::string visitVariableExpr(const Variable* expr) {
+        return std::string(expr->name.lexeme);
+    }
+
+    std::string visitLiteralExpr(const Literal* expr) {
+        return literal(expr->value);
+    }
+
+    // Same prefix form for the flattened tree (groupings were folded away while flattening)
+    std::string print(const FlatAst& ast, std::uint32_t index){
+        const FlatNode& node = ast[index];
+        std::string op(ast.location(node).lexeme);
+
+        switch(node.kind){
+            case(LITERAL): return literal(ast.constants[node.a]);
+            case(VARIABLE): return op;
+            case(ASSIGN): return "(= " + op + " " + print(ast, node.a) + ")";
+            case(UNARY): return "(" + op + " " + print(ast, node.a) + ")";
+            case(BINARY):
+            case(LOGICAL): return "(" + op + " " + print(ast, node.a) + " " + print(ast, node.b) + ")";
+            case(TERNARY): return "(? : " + print(ast, node.a) + " " + print(ast, node.b) + " " + print(ast, node.c) + ")";
+            case(DEEP): return print(ast, node.a);
+            default: break;
+        }
+
+        return "Error in print: not an expression node.";
+    }
+
+private:
+    // We don't know the type of literal so we handle it before converting to string
+    std::string literal(const Value& value){
+
+        if(std::holds_alternative<std::nullptr_t>(value)){
             return std::string("nil");
         }
-        else if(value_type == typeid(std::string)){
-            return std::any_cast<std::string>(expr->value);
+        else if(std::holds_alternative<std::string>(value)){
+            return std::get<std::string>(value);
         }
-        else if(value_type == typeid(bool)){
-            return std::any_cast<bool>(expr->value) ? std::string("true") : std::string("false");
+        else if(std::holds_alternative<Symbol>(value)){
+            return std::get<Symbol>(value).str();
         }
-        else if(value_type == typeid(double)){
-            return std::to_string(std::any_cast<double>(expr->value));
+        else if(std::holds_alternative<bool>(value)){
+            return std::get<bool>(value) ? std::string("true") : std::string("false");
+        }
+        else if(std::holds_alternative<double>(value)){
+            return std::to_string(std::get<double>(value));
         }
 
         return "Error in visitLiteralExpr: literal type not recognized.";
@@ -69,9 +109,9 @@ public:
 
 };
 
-class AstPrinterRPN : public ExprVisitor {
+class AstPrinterRPN : public ExprVisitor<AstPrinterRPN, std::string> {
 private:
-    // Need a multi-parameter template class - we might pass std::shared_ptr<Literal>, Unary etc any of those
+    // Need a multi-parameter template class - we might pass const Literal*, Unary* etc any of those
     template <class... E> // Expect multiple template  params (class... E)
     std::string parenthesize(std::string name, E... expr ){ // Expand the arguments E...
         
@@ -90,39 +130,55 @@ private:
     }
 
 public:
-    std::string print(std::shared_ptr<Expr> expr){
-        return std::any_cast<std::string>(expr->accept(*this)); // *this passes a copy of current object
+    std::string print(const Expr* expr){
+        return visit(expr);
     }
 
-    std::any visitBinaryExpr(std::shared_ptr<Binary> expr) override {
-        return parenthesize(expr->op.lexeme, expr->left, expr->right);
+    std::string visitBinaryExpr(const Binary* expr) {
+        return parenthesize(std::string(expr->op.lexeme), expr->left, expr->right);
     }
 
-    std::any visitUnaryExpr(std::shared_ptr<Unary> expr) override {
-        return parenthesize(expr->op.lexeme,expr->right);
+    std::string visitUnaryExpr(const Unary* expr) {
+        return parenthesize(std::string(expr->op.lexeme),expr->right);
     }
 
-    std::any visitGroupingExpr(std::shared_ptr<Grouping> expr) override {
+    std::string visitGroupingExpr(const Grouping* expr) {
         return parenthesize("group", expr->expression);
     }
 
-    
+    std::string visitTernaryExpr(const Ternary* expr) {
+        return parenthesize(std::string(expr->leftOp.lexeme) + " " + std::string(expr->middleOp.lexeme), expr->left, expr->middle, expr->right);
+    }
+
+    std::string visitAssignExpr(const Assign* expr) {
+        return parenthesize("= " + std::string(expr->name.lexeme), expr->value);
+    }
+
+    std::string visitLogicalExpr(const Logical* expr) {
+        return parenthesize(std::string(expr->op.lexeme), expr->left, expr->right);
+    }
 
-    std::any visitLiteralExpr(std::shared_ptr<Literal> expr) override {
+    std::string visitVariableExpr(const Variable* expr) {
+        return std::string(expr->name.lexeme);
+    }
+
+    std::string visitLiteralExpr(const Literal* expr) {
         // We don't know the type of literal so we handle it before converting to string
-        auto& value_type = expr->value.type();
 
-        if(value_type == typeid(nullptr)){
+        if(std::holds_alternative<std::nullptr_t>(expr->value)){
             return std::string("nil");
         }
-        if(value_type == typeid(std::string)){
-            return std::any_cast<std::string>(expr->value);
+        if(std::holds_alternative<std::string>(expr->value)){
+            return std::get<std::string>(expr->value);
+        }
+        if(std::holds_alternative<Symbol>(expr->value)){
+            return std::get<Symbol>(expr->value).str();
         }
-        if(value_type == typeid(bool)){
-            return std::any_cast<bool>(expr->value) ? std::string("true") : std::string("false");
+        if(std::holds_alternative<bool>(expr->value)){
+            return std::get<bool>(expr->value) ? std::string("true") : std::string("false");
         }
-        if(value_type == typeid(double)){
-            return std::to_string(std::any_cast<double>(expr->value));
+        if(std::holds_alternative<double>(expr->value)){
+            return std::to_string(std::get<double>(expr->value));
         }
 
         return "Error in visitLiteralExpr: literal type not recognized.";
@@ -6,29 +6,31 @@
 #include"error.h"
 #include"../scanner/scanner.h"
 #include"../parser/parser.h"
+#include"arena.h"
 #include"AstPrinter.h"
 
 int main(int argc, char* argv[]) {
-  std::shared_ptr<Expr> expression = std::make_shared<Binary>(
-      std::make_shared<Unary>(
+  Arena arena;
+  const Expr* expression = arena.make<Binary>(
+      arena.make<Unary>(
           Token{MINUS, "-", nullptr, 1},
-          std::make_shared<Literal>(123.)
+          arena.make<Literal>(123.)
       ),
       Token{STAR, "*", nullptr, 1},
-      std::make_shared<Grouping>(
-          std::make_shared<Literal>(true)));
+      arena.make<Grouping>(
+          arena.make<Literal>(true)));
   
-  std::shared_ptr<Expr> expression2 = std::make_shared<Binary>(
-      std::make_shared<Binary>(
-          std::make_shared<Literal>(1.),
+  const Expr* expression2 = arena.make<Binary>(
+      arena.make<Binary>(
+          arena.make<Literal>(1.),
           Token{MINUS, "+", nullptr, 1},
-          std::make_shared<Literal>(2.)
+          arena.make<Literal>(2.)
       ),
       Token{STAR, "*", nullptr, 1},
-      std::make_shared<Binary>(
-          std::make_shared<Literal>(4.),
+      arena.make<Binary>(
+          arena.make<Literal>(4.),
           Token{MINUS, "-", nullptr, 1},
-          std::make_shared<Literal>(3.) )
+          arena.make<Literal>(3.) )
           );
 
   std::cout << AstPrinter{}.print(expression) << "\n";
@@ -0,0 +1,158 @@
+// Checks and times the incremental reparsing of Document (parser/document.h).
+//
+//   g++ -std=c++17 -O2 -pthread DocumentTest.cpp -o DocumentTest
+//   ./DocumentTest fuzz script.lox [edits] [seed]   random edits, each checked against a full reparse
+//   ./DocumentTest bench script.lox [edits]         latency of small edits that keep the script valid
+#include<algorithm>
+#include<chrono>
+#include<cstdlib>
+#include<fstream>
+#include<iostream>
+#include<random>
+#include<sstream>
+#include<string>
+#include<vector>
+#include"error.h"
+#include"arena.h"
+#include"../scanner/scanner.h"
+#include"../scanner/utf8.h"
+#include"../parser/parser.h"
+#include"../parser/document.h"
+#include"../interpreter/flatAst.h"
+
+// Everything a full parse produces that the document must match : the flat tree with its line numbers and lexemes
+std::string describe(const FlatAst& ast){
+  std::ostringstream out;
+  for(const FlatNode& node : ast.nodes){
+    out<<int(node.kind)<<" "<<int(node.op)<<" "<<node.a<<" "<<node.b<<" "<<node.c<<" "<<node.loc<<"\n";
+  }
+  for(const Location& location : ast.locations) out<<location.line<<" "<<location.lexeme<<"\n";
+  out<<ast.constants.size()<<" constants, "<<ast.globals<<" globals\n";
+  return out.str();
+}
+
+// Diagnostics in a stable order (the document reports scanner errors per statement)
+std::string describe(const std::vector<Diagnostic>& diagnostics){
+  std::vector<std::string> lines;
+  for(const Diagnostic& diagnostic : diagnostics){
+    lines.push_back(std::to_string(diagnostic.line) + diagnostic.where + ": " + diagnostic.message);
+  }
+  std::sort(lines.begin(), lines.end());
+  std::string out;
+  for(const std::string& line : lines) out += line + "\n";
+  return out;
+}
+
+// What a full scan and parse of `text` reports
+std::vector<Diagnostic> fullDiagnostics(const std::string& text, std::vector<const Stmt*>& statements, Arena& arena){
+  Scanner scanner(text, 0, text.size(), true);
+  TokenBuffer tokens = scanner.scanChunk();
+  tokens.push(END_OF_FILE, static_cast<std::uint32_t>(text.size()), 0, scanner.lastLine());
+
+  std::vector<Diagnostic> diagnostics = scanner.diagnostics;
+  if(validateUtf8(text) != std::string_view::npos) diagnostics.push_back({0, "", "Invalid UTF-8 encoding."});
+
+  Parser parser(tokens, arena);
+  statements = parser.parse();
+  diagnostics.insert(diagnostics.end(), parser.diagnostics.begin(), parser.diagnostics.end());
+  return diagnostics;
+}
+
+int fuzz(const std::string& source, int edits, unsigned seed){
+  // Pieces that open or close strings, comments, blocks and statements, so regions have to grow
+  const char* pieces[] = {"\"", "/*", "*/", "//", "\n", "{", "}", "else", ";", "if (x) ", "print 1;\n", " ", "(", ")",
+                          "x", "var", "+", "@", "else print 2;"};
+  std::mt19937 random(seed);
+  Document document(source);
+  std::string text = source;
+  std::size_t reparsed = 0;
+
+  for(int i = 0; i < edits; ++i){
+    std::size_t offset = random() % (text.size() + 1);
+    std::size_t removed = std::min<std::size_t>(random() % 3 == 0 ? random() % 8 : 0, text.size() - offset);
+    std::string inserted = random() % 4 == 0 ? "" : pieces[random() % (sizeof(pieces) / sizeof(*pieces))];
+    if(inserted.empty() && removed == 0) removed = std::min<std::size_t>(1, text.size() - offset);
+
+    document.edit(offset, removed, inserted);
+    text.replace(offset, removed, inserted);
+    reparsed += document.reparsed();
+
+    Arena arena;
+    std::vector<const Stmt*> statements;
+    std::vector<Diagnostic> expected = fullDiagnostics(text, statements, arena);
+
+    // Line numbers from the UTF-8 check are computed differently, compare only that there is one
+    std::vector<Diagnostic> actual = document.diagnostics();
+    for(Diagnostic& diagnostic : actual){
+      if(diagnostic.message == "Invalid UTF-8 encoding.") diagnostic.line = 0;
+    }
+
+    bool same = std::string(document.text()) == text && describe(expected) == describe(actual);
+    // Only a tree without errors is ever flattened
+    if(same && expected.empty()) same = describe(Flattener{}.flatten(statements)) == describe(document.flatten());
+    if(!same){
+      std::cerr<<"Mismatch after edit "<<i<<" (offset "<<offset<<", removed "<<removed<<", inserted \""<<inserted<<"\")\n"
+               <<"expected:\n"<<describe(expected)<<"document:\n"<<describe(actual);
+      return 1;
+    }
+  }
+
+  std::cout<<edits<<" edits match a full reparse, "<<double(reparsed) / std::max(edits, 1)<<" statements reparsed per edit\n";
+  return 0;
+}
+
+int bench(const std::string& source, int edits){
+  std::size_t digits = std::count_if(source.begin(), source.end(), [](unsigned char c){ return std::isdigit(c); });
+  if(digits == 0){
+    std::cerr<<"The script needs number literals to edit\n";
+    return 1;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  Document document(source);
+  double full = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+  // Type a digit over a digit, or a `;` after one and delete it again : the script stays valid
+  std::mt19937 random(1);
+  std::vector<double> times;
+  for(int i = 0; i < edits; ++i){
+    std::string_view text = document.text();
+    std::size_t offset;
+    do offset = random() % text.size(); while(!std::isdigit(static_cast<unsigned char>(text[offset])));
+
+    auto before = std::chrono::steady_clock::now();
+    if(i % 2 != 0) document.edit(offset, 1, "7");
+    else document.edit(offset, 0, ";");
+    times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - before).count());
+
+    if(i % 2 == 0) document.edit(offset, 1, "");
+  }
+
+  std::sort(times.begin(), times.end());
+  std::cout<<document.statements().size()<<" statements, full parse "<<full<<" ms\n"
+           <<"edit median "<<times[times.size() / 2]<<" ms, p99 "<<times[times.size() * 99 / 100]<<" ms\n";
+  return 0;
+}
+
+int main(int argc, char* argv[]) {
+  if(argc < 3){
+    std::cerr<<"Usage: DocumentTest fuzz script [edits] [seed]\n"
+             <<"       DocumentTest bench script [edits]\n";
+    return 64;
+  }
+
+  std::ifstream file(argv[2]);
+  if(!file){
+    std::cerr<<"Failed to open file "<<argv[2]<<"\n";
+    return 74;
+  }
+  std::stringstream contents;
+  contents<<file.rdbuf();
+
+  std::string mode = argv[1];
+  int edits = argc > 3 ? std::atoi(argv[3]) : 2000;
+  if(mode == "fuzz") return fuzz(contents.str(), edits, argc > 4 ? std::atoi(argv[4]) : 1);
+  if(mode == "bench") return bench(contents.str(), std::max(edits, 2));
+  std::cerr<<"Unknown mode "<<mode<<"\n";
+  return 64;
+}
@@ -0,0 +1,100 @@
+// Counts the heap allocations and times Parser::parse(), so that token copies creeping back into the parser show up.
+//
+//   g++ -std=c++17 -O2 -pthread ParserBench.cpp -o ParserBench
+//   ./ParserBench                generated workloads : 200k expression statements, 1M `print 1;`
+//   ./ParserBench script.lox     that script
+//
+// Scanning is done before counting starts : only what the parser itself allocates is reported (arena blocks
+// and vector growth, nothing per token).
+#include<algorithm>
+#include<chrono>
+#include<cstdlib>
+#include<fstream>
+#include<iostream>
+#include<new>
+#include<sstream>
+#include<string>
+#include<vector>
+#include"error.h"
+#include"arena.h"
+#include"../scanner/scanner.h"
+#include"../parser/parser.h"
+
+// Every operator new goes through here, counted while `counting` is set
+static bool counting = false;
+static std::size_t allocations = 0;
+
+void* operator new(std::size_t size){
+  if(counting) ++allocations;
+  if(void* memory = std::malloc(size == 0 ? 1 : size)) return memory;
+  throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept {
+  std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept {
+  std::free(memory);
+}
+
+// A statement per line using every kind of expression, with lexemes too long for the small string buffer
+std::string expressions(int statements){
+  std::ostringstream out;
+  for(int i = 0; i < statements; ++i){
+    out<<"variable"<<i % 100<<" = (first + 12.5) * second - \"a string literal\" / third == !fourth or fifth and sixth;\n";
+  }
+  return out.str();
+}
+
+std::string prints(int statements){
+  std::string out;
+  for(int i = 0; i < statements; ++i) out += "print 1;\n";
+  return out;
+}
+
+int bench(const std::string& name, const std::string& source){
+  Scanner scanner(source, 0, source.size(), true);
+  TokenBuffer tokens = scanner.scanChunk();
+  tokens.push(END_OF_FILE, static_cast<std::uint32_t>(source.size()), 0, scanner.lastLine());
+
+  Arena arena;
+  Parser parser(tokens, arena);
+
+  allocations = 0;
+  counting = true;
+  auto start = std::chrono::steady_clock::now();
+  std::vector<const Stmt*> statements = parser.parse();
+  double time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  counting = false;
+
+  std::cout<<name<<" : "<<statements.size()<<" statements, "<<tokens.size()<<" tokens\n"
+           <<"  allocations "<<allocations<<" ("<<1000.0 * allocations / tokens.size()<<" per 1000 tokens), parse "<<time<<" ms\n";
+  if(!parser.diagnostics.empty()){
+    std::cerr<<"  "<<parser.diagnostics.size()<<" syntax errors\n";
+    return 1;
+  }
+  return 0;
+}
+
+int main(int argc, char* argv[]) {
+  if(argc > 2){
+    std::cerr<<"Usage: ParserBench [script]\n";
+    return 64;
+  }
+
+  if(argc == 2){
+    std::ifstream file(argv[1]);
+    if(!file){
+      std::cerr<<"Failed to open file "<<argv[1]<<"\n";
+      return 74;
+    }
+    std::stringstream contents;
+    contents<<file.rdbuf();
+    return bench(argv[1], contents.str());
+  }
+
+  int failed = bench("200k expression statements", expressions(200000));
+  failed |= bench("1M print statements", prints(1000000));
+  return failed;
+}
@@ -0,0 +1,105 @@
+// Runs machine-sized expressions through the whole pipeline, to keep the paths that must not recurse per term
+// (spine loops in the parser, the optimizer and the Flattener, the explicit stack of the interpreter) covered.
+//
+//   g++ -std=c++17 -O2 -pthread StressTest.cpp -o StressTest
+//   ./StressTest [terms]      chains of `terms` terms (1M by default), with and without the optimizer
+//
+// Each case checks what the script prints, or that nesting past the parser's limit is a clean error.
+#include<chrono>
+#include<cstdlib>
+#include<iostream>
+#include<sstream>
+#include<string>
+#include<vector>
+#include"error.h"
+#include"arena.h"
+#include"../scanner/parallelScanner.h"
+#include"../parser/parser.h"
+#include"../parser/parallelParser.h"
+#include"../interpreter/interpreter.h"
+#include"../optimizer/constantFolder.h"
+#include"../optimizer/deadCode.h"
+#include"../optimizer/loopInvariant.h"
+#include"../optimizer/cse.h"
+
+struct Case {
+  std::string name;
+  std::string source;
+  std::string expected;  // what the script prints, or the error it reports
+};
+
+// `first op term op term ...` with `terms` terms. The terms are variables assigned once, so that the
+// ConstantFolder can't fold the chain away
+std::string chain(const std::string& declarations, const std::string& term, const std::string& op, int terms){
+  std::string source = declarations + "print " + term;
+  source.reserve(source.size() + terms * (term.size() + op.size() + 2));
+  for(int i = 1; i < terms; ++i) source += " " + op + " " + term;
+  return source + ";\n";
+}
+
+// `open` `depth` times around `inner`, then `close` as many times
+std::string nested(const std::string& open, const std::string& inner, const std::string& close, int depth){
+  std::string source;
+  for(int i = 0; i < depth; ++i) source += open;
+  source += inner;
+  for(int i = 0; i < depth; ++i) source += close;
+  return source;
+}
+
+// Everything run() in lox.cpp does but the cache. What it prints, or its first syntax error
+std::string run(const std::string& source, bool optimize){
+  TokenBuffer tokens = ParallelScanner(source).scanTokens();
+  Arena arena;
+  ParallelParser parser(tokens, arena, Parser::defaultMaxDepth);
+  std::vector<const Stmt*> statements = parser.parse();
+  if(!parser.diagnostics.empty()) return parser.diagnostics[0].message;
+
+  if(optimize){
+    statements = ConstantFolder(arena).fold(statements);
+    statements = DeadCode(arena).prune(statements);
+    statements = LoopInvariants(arena).hoist(statements);
+    statements = CommonSubexpressions(arena).eliminate(statements);
+  }
+  FlatAst program = Flattener{}.flatten(statements);
+
+  std::ostringstream out;
+  std::streambuf* console = std::cout.rdbuf(out.rdbuf());
+  Interpreter{}.interpret(program);
+  std::cout.rdbuf(console);
+  return out.str();
+}
+
+int main(int argc, char* argv[]) {
+  int terms = argc > 1 ? std::atoi(argv[1]) : 1000000;
+  if(argc > 2 || terms < 1){
+    std::cerr<<"Usage: StressTest [terms]\n";
+    return 64;
+  }
+  int tooDeep = Parser::defaultMaxDepth * 50;
+
+  std::vector<Case> cases = {
+    {"+ chain", chain("var x = 1;\nx = 1;\n", "x", "+", terms), std::to_string(double(terms)) + "\n"},
+    {"and chain", chain("var t = true;\nt = true;\n", "t", "and", terms), "true\n"},
+    {"or chain", chain("var f = false;\nf = false;\n", "f", "or", terms), "false\n"},
+    {"parentheses at half the limit", "var x = 1;\nprint " + nested("(", "x", ")", Parser::defaultMaxDepth / 2) + ";\n", "1.000000\n"},
+    {"parentheses past the limit", "print " + nested("(", "1", ")", tooDeep) + ";\n", "Nesting is too deep."},
+    {"unary past the limit", "print " + nested("-", "1", "", tooDeep) + ";\n", "Nesting is too deep."},
+    {"blocks past the limit", nested("{", "print 1;", "}", tooDeep) + "\n", "Nesting is too deep."},
+  };
+
+  int failed = 0;
+  for(const Case& test : cases){
+    for(bool optimize : {false, true}){
+      auto start = std::chrono::steady_clock::now();
+      std::string output = run(test.source, optimize);
+      double time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+      bool passed = output == test.expected;
+      failed += !passed;
+      std::cout<<(passed ? "ok   " : "FAIL ")<<test.name<<(optimize ? " (optimized)" : "")<<" : "<<time<<" ms\n";
+      if(!passed) std::cout<<"  expected "<<test.expected<<"  got "<<output.substr(0, 200)<<"\n";
+    }
+  }
+
+  return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include<algorithm>
+#include<cstddef>
+#include<cstdint>
+#include<memory>
+#include<new>
+#include<type_traits>
+#include<utility>
+#include<vector>
+
+/*
+Bump allocator for AST nodes.
+    - make<T>(...) carves the node out of the current block (a pointer bump, no malloc per node)
+    - Nodes are never freed one by one : the whole arena goes at once when it is destroyed,
+      running the destructors of the nodes that need one (Tokens, vectors) in reverse order
+The parser hands out raw const pointers into the arena, so the arena must outlive every use of the tree.
+*/
+class Arena{
+
+public:
+    Arena() = default;
+    Arena(Arena&&) = default;
+    Arena& operator=(Arena&&) = default;
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    ~Arena(){
+        for(auto it = destructors.rbegin(); it != destructors.rend(); ++it){
+            it->destroy(it->object);
+        }
+    }
+
+    template <class T, class... Args>
+    T* make(Args&&... args){
+        void* memory = allocate(sizeof(T), alignof(T));
+        T* object = new (memory) T(std::forward<Args>(args)...);
+        if constexpr (!std::is_trivially_destructible_v<T>) {
+            destructors.push_back({object, [](void* p){ static_cast<T*>(p)->~T(); }});
+        }
+        return object;
+    }
+
+    // Take over every node of `other` (they stay where they are), leaving it empty
+    void adopt(Arena&& other){
+        blocks.insert(blocks.end(), std::make_move_iterator(other.blocks.begin()), std::make_move_iterator(other.blocks.end()));
+        destructors.insert(destructors.end(), other.destructors.begin(), other.destructors.end());
+        used += other.used;
+
+        other.blocks.clear();
+        other.destructors.clear();
+        other.cursor = other.end = nullptr;
+        other.used = 0;
+    }
+
+    // Bytes handed out so far (not counting block slack)
+    std::size_t bytesUsed() const {
+        return used;
+    }
+
+private:
+    static constexpr std::size_t blockSize = 64 * 1024;
+
+    struct Destructor {
+        void* object;
+        void (*destroy)(void*);
+    };
+
+    std::vector<std::unique_ptr<std::byte[]>> blocks;
+    std::byte* cursor = nullptr;
+    std::byte* end = nullptr;
+    std::size_t used = 0;
+    std::vector<Destructor> destructors;
+
+    void* allocate(std::size_t size, std::size_t align){
+        std::size_t padding = cursor ? (align - reinterpret_cast<std::uintptr_t>(cursor) % align) % align : 0;
+        if(cursor == nullptr || padding + size > static_cast<std::size_t>(end - cursor)){
+            // Oversized requests get a block of their own
+            std::size_t capacity = std::max(blockSize, size + align);
+            blocks.emplace_back(new std::byte[capacity]);  // left uninitialized, unlike make_unique
+            cursor = blocks.back().get();
+            end = cursor + capacity;
+            padding = (align - reinterpret_cast<std::uintptr_t>(cursor) % align) % align;
+        }
+
+        void* memory = cursor + padding;
+        cursor += padding + size;
+        used += size;
+        return memory;
+    }
+};
@@ -9,18 +9,29 @@
 inline bool hadError = false; 
 inline bool hadRuntimeError = false; 
 
+// An error held back to be reported later (eg. by a parallel scan, in source order)
+struct Diagnostic {
+    int line;
+    std::string where;
+    std::string message;
+};
+
 static void report(int line, std::string where, std::string message){
     std::cerr<<"[line : "<<line<<"] Error - "<<message<<std::endl;
     hadError = true;
 }
 
-static void error(const Token& token, std::string message){
+// Report an error held back until now
+static void report(const Diagnostic& diagnostic){
+    report(diagnostic.line, diagnostic.where, diagnostic.message);
+}
+
+// Error located at a token, built without reporting it
+static Diagnostic diagnostic(const Token& token, std::string message){
     if(token.type == END_OF_FILE) {
-        report(token.line, " at end", message);
-    }
-    else{
-        report(token.line, " at '" + token.lexeme + "'",message);
+        return Diagnostic{token.line, " at end", std::move(message)};
     }
+    return Diagnostic{token.line, " at '" + std::string(token.lexeme) + "'", std::move(message)};
 }
 
 static void error(int line, std::string message){
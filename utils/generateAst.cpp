@@ -1,6 +1,9 @@
 // This script will be used to generate the class template for visitor design pattern
-// Uses std::shared_ptr for smart pointer memory management
-// C++ does not allow templates in abstract classes, we use std::any and cast it later on
+// Nodes are bump-allocated from an Arena (utils/arena.h) and referenced through raw const pointers,
+// the arena owns them and frees the whole tree at once
+// C++ does not allow templates in abstract classes (virtual accept), so instead of returning std::any
+// every node carries a kind tag and the visitors are CRTP templates : each visitor picks its own
+// return type and dispatch is a switch on the tag, with no virtual call and nothing boxed
 
 #include<iostream>
 #include<algorithm>
@@ -52,7 +55,7 @@ std::string toLower(std::string str){
     return out;
 }
 
-// To convert * -> shared_ptr for auto memory management
+// To convert * -> const * : nodes are immutable once built and owned by the arena
 std::string fix_pointer(std::string field){
     std::string type = trim(split(field," ")[0]);
     std::string name = trim(split(field," ")[1]);
@@ -66,10 +69,9 @@ std::string fix_pointer(std::string field){
         close_bracket = true;
     }
 
-    // If its a pointer to base class, convert to shared_ptr
+    // If its a pointer to base class, point to a const node
     if(type.back() == '*'){
-        type = type.substr(0,type.end() - type.begin() - 1);
-        out << "std::shared_ptr<" << type << ">";
+        out << "const " << type;
     } else {
         out << type;
     }
@@ -80,22 +82,32 @@ std::string fix_pointer(std::string field){
     return out.str();
 }
 
-// Define the base visitor class
-// This will map the desired function to the correct type
+// Define the visitor class template
+// This will map the desired function to the correct type : visit() switches on the node's kind
+// and calls Derived::visitXBase directly, returning whatever type R the visitor works with
 void defineVisitor(std::ofstream& writer, std::string baseName, const std::vector<std::string>& types){
-    writer << "struct " << baseName << "Visitor {\n";
-
-    for(std::string type : types){
-        std::string typeName = trim(split(type,": ")[0]);
-        writer << "virtual std::any visit" << typeName << baseName <<"(std::shared_ptr<" << typeName << "> " << toLower(baseName) << ") = 0;\n";
+    writer << "template <class Derived, class R>\n"
+              "struct " << baseName << "Visitor {\n"
+              "  R visit(const " << baseName << "* " << toLower(baseName) << ") {\n"
+              "    Derived& self = static_cast<Derived&>(*this);\n"
+              "    switch (" << toLower(baseName) << "->kind) {\n";
+
+    for(int i = 0; i < types.size(); ++i){
+        std::string typeName = trim(split(types[i],": ")[0]);
+        // The last kind doubles as default so every path returns
+        if(i + 1 == types.size()) writer << "      default:\n";
+        writer << "      case " << baseName << "Kind::" << typeName << ":\n"
+                  "        return self.visit" << typeName << baseName << "(static_cast<const " << typeName << "*>(" << toLower(baseName) << "));\n";
     }
-    // Define virtual destructor
-    writer << "virtual ~" << baseName << "Visitor() = default;\n" << "};\n";
+
+    writer << "    }\n"
+              "  }\n"
+              "};\n";
 }
 
 // Defining each type
 void defineType(std::ofstream& writer, std::string baseName, std::string className, std::string fieldList){
-    writer << "struct " << className << ": " << baseName << ", public std::enable_shared_from_this<" << className << "> {\n";
+    writer << "struct " << className << ": " << baseName << " {\n";
 
     // Constructor
     writer << "  " << className << "(";
@@ -107,61 +119,57 @@ void defineType(std::ofstream& writer, std::string baseName, std::string classNa
         writer << ", " << fix_pointer(fields[i]);
     }
 
-    writer << ")\n" << "  : ";
+    writer << ")\n" << "  : " << baseName << "{" << baseName << "Kind::" << className << "}";
 
     // Store parameters in fields.
-    std::string name = split(fields[0], " ")[1];
-    writer << name << "{std::move(" << name << ")}";
-
-    for (int i = 1; i < fields.size(); ++i) {
-        name = split(fields[i], " ")[1];
+    for (int i = 0; i < fields.size(); ++i) {
+        std::string name = split(fields[i], " ")[1];
         writer << ", " << name << "{std::move(" << name << ")}";
     }
 
     writer << "\n"
             << "  {}\n";
 
-    // Visitor pattern.
-    writer << "\n"
-                "  std::any accept(" << baseName << "Visitor& visitor)"
-                    " override {\n"
-                "    return visitor.visit" << className << baseName <<
-                    "(shared_from_this());\n"
-                "  }\n";
-
     // Fields.
     writer << "\n";
     for(std::string field : fields){
-        writer << "  const " << fix_pointer(field) << ";\n";
+        std::string type = trim(split(field," ")[0]);
+        std::string name = trim(split(field," ")[1]);
+        // Pointer fields are already pointer-to-const, so the pointer itself is made const
+        if(type.back() == '*') writer << "  const " << type << " const " << name << ";\n";
+        else writer << "  const " << fix_pointer(field) << ";\n";
     } 
 
     writer << "};\n\n";
 }
 
-void defineAst(const std::string& output_dir,const std::string& baseName,const std::vector<std::string>& types){
-    std::string path = output_dir + "/" + baseName + ".h";
+void defineAst(const std::string& path,const std::string& baseName,const std::vector<std::string>& includes,const std::vector<std::string>& types){
     std::ofstream writer{path};
 
     writer << "#pragma once\n"
                 "\n"
-                "#include <any>\n"
-                "#include <memory>\n"
+                "#include <cstdint>\n"
                 "#include <utility>  // std::move\n"
-                "#include <vector>\n"
-                "#include \"../scanner/token.h\"\n"
-                "\n";
+                "#include <vector>\n";
+    for (const std::string& include : includes){
+        writer << "#include \"" << include << "\"\n";
+    }
+    writer << "\n";
 
+    // One tag per node type, stored in the base so visitors can dispatch without a vtable
+    writer << "enum class " << baseName << "Kind : std::uint8_t {\n";
     for (auto type : types){
-        writer << "struct " << trim(split(type,":")[0]) <<";\n";
+        writer << "  " << trim(split(type,":")[0]) << ",\n";
     }
+    writer << "};\n";
 
-    // The visitor class (Abstract)
-    writer<<'\n';
-    defineVisitor(writer, baseName, types);
-
-    // The base class
+    // The base class : no virtual functions, the arena destroys nodes through their concrete type
     writer<<'\n' << "struct " << baseName << "\n" <<"{\n"
-           " virtual std::any accept(" << baseName << "Visitor& visitor) = 0;\n" << "};\n\n";
+           "  const " << baseName << "Kind kind;\n"
+           "\n"
+           "protected:\n"
+           "  explicit " << baseName << "(" << baseName << "Kind kind) : kind(kind) {}\n"
+           "};\n\n";
 
     // Define all types
     for(std::string type : types){
@@ -169,30 +177,33 @@ void defineAst(const std::string& output_dir,const std::string& baseName,const s
         std::string fields = trim(split(type,": ")[1]);
         defineType(writer,baseName, className, fields);
     }
+
+    // The visitor comes last : its switch needs the complete node types to cast to
+    defineVisitor(writer, baseName, types);
 }
 
 int main(int argc, char** argv){
     
     if(argc != 2){
-        std::cout<<"Usage: generateAst.cpp <output_dir>\n";
+        std::cout<<"Usage: generateAst.cpp <repo_root>\n";
         std::exit(64);
     }
     
-    std::string output_dir = argv[1];
+    std::string root = argv[1];
     
-    // (out_dir,base_name,types)
-    // defineAst(output_dir, "Expr", {
-    //     "Assign   : Token name, Expr* value",
-    //     "Binary   : Expr* left, Token op, Expr* right",
-    //     "Logical  : Expr* left, Token op, Expr* right",
-    //     "Unary    : Token op, Expr* right",
-    //     "Literal  : std::any value",
-    //     "Grouping : Expr* expression",
-    //     "Ternary  : Expr* left, Expr* middle, Expr* right, Token leftOp, Token middleOp",
-    //     "Variable : Token name"
-    // });
-
-    defineAst(output_dir, "Stmt", {
+    // (path,base_name,includes,types)
+    defineAst(root + "/scanner/Expr.h", "Expr", {"../scanner/token.h", "../utils/value.h"}, {
+        "Assign   : Token name, Expr* value",
+        "Binary   : Expr* left, Token op, Expr* right",
+        "Logical  : Expr* left, Token op, Expr* right",
+        "Unary    : Token op, Expr* right",
+        "Literal  : Value value",
+        "Grouping : Expr* expression",
+        "Ternary  : Expr* left, Token leftOp, Expr* middle, Token middleOp, Expr* right",
+        "Variable : Token name"
+    });
+
+    defineAst(root + "/interpreter/Stmt.h", "Stmt", {"../scanner/token.h", "../scanner/Expr.h"}, {
         "Block      : std::vector<Stmt*> statements",
         "Expression : Expr* expression",
         "If         : Expr* condition, Stmt* thenBranch, Stmt* elseBranch",
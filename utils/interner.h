@@ -0,0 +1,76 @@
+#pragma once
+
+#include<deque>
+#include<functional>
+#include<mutex>
+#include<string>
+#include<string_view>
+#include<unordered_map>
+
+/*
+Global symbol table for identifiers and string literals.
+Every distinct text is stored exactly once and never freed, so a Symbol is just a stable pointer :
+comparing or hashing two Symbols is a pointer compare/hash instead of a string compare/hash.
+The table is shared by every thread (ParallelParser interns from several at once) : each thread keeps
+its own cache of the symbols it has already seen, and only takes the lock on a miss.
+*/
+struct Symbol {
+    const std::string* text = nullptr;
+
+    const std::string& str() const {
+        return *text;
+    }
+
+    bool operator==(const Symbol& other) const {
+        return text == other.text;
+    }
+
+    bool operator!=(const Symbol& other) const {
+        return text != other.text;
+    }
+};
+
+template <>
+struct std::hash<Symbol> {
+    std::size_t operator()(const Symbol& symbol) const {
+        return std::hash<const std::string*>{}(symbol.text);
+    }
+};
+
+class Interner {
+
+public:
+    static Symbol intern(std::string_view text){
+        static Interner table;
+        // Keys view the strings of the shared table, which are never freed
+        thread_local std::unordered_map<std::string_view, const std::string*> cache;
+
+        auto it = cache.find(text);
+        if(it != cache.end()) return Symbol{it->second};
+
+        Symbol symbol = table.lookup(text);
+        cache.emplace(symbol.str(), symbol.text);
+        return symbol;
+    }
+
+private:
+    // deque never moves its elements, so the keys (views into them) and the handed out pointers stay valid
+    std::deque<std::string> strings;
+    std::unordered_map<std::string_view, const std::string*> index;
+    std::mutex lock;
+
+    Symbol lookup(std::string_view text){
+        std::lock_guard<std::mutex> guard(lock);
+
+        auto it = index.find(text);
+        if(it != index.end()) return Symbol{it->second};
+
+        const std::string& stored = strings.emplace_back(text);
+        index.emplace(stored, &stored);
+        return Symbol{&stored};
+    }
+};
+
+inline Symbol intern(std::string_view text){
+    return Interner::intern(text);
+}
@@ -5,7 +5,8 @@
 
 class RuntimeError : public std::runtime_error {
 public:
-    const Token& token;
+    // Held by value : the token an error is raised for may be a temporary (eg. rebuilt from a flat AST)
+    const Token token;
 
     RuntimeError(const Token& _token, std::string msg) 
     : std::runtime_error{msg} , token{_token} 
@@ -0,0 +1,93 @@
+#pragma once
+
+#include<algorithm>
+#include<cerrno>
+#include<string>
+#include<string_view>
+#include<utility>
+#include<fcntl.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<unistd.h>
+
+/*
+Owns the bytes of a script for as long as its tokens and AST are alive (lexemes are views into it).
+    - Regular files are memory-mapped read-only : no copy, pages are faulted in as the scanner reaches them
+    - Anything else (stdin, pipes, fifos) can't be mapped, so it is read in fixed size chunks into one growing string
+Either way there is a single resident copy of the source.
+*/
+class SourceBuffer{
+
+public:
+    SourceBuffer() = default;
+
+    SourceBuffer(SourceBuffer&& other) noexcept
+    : mapped(std::exchange(other.mapped, nullptr)), mappedSize(std::exchange(other.mappedSize, 0)), streamed(std::move(other.streamed))
+    {}
+
+    SourceBuffer& operator=(SourceBuffer&& other) noexcept {
+        std::swap(mapped, other.mapped);
+        std::swap(mappedSize, other.mappedSize);
+        std::swap(streamed, other.streamed);
+        return *this;
+    }
+
+    SourceBuffer(const SourceBuffer&) = delete;
+    SourceBuffer& operator=(const SourceBuffer&) = delete;
+
+    ~SourceBuffer(){
+        if(mapped != nullptr) munmap(mapped, mappedSize);
+    }
+
+    // Load from an open descriptor. Returns false (with errno set) on failure
+    bool load(int fd){
+        struct stat info;
+        if(fstat(fd, &info) != 0) return false;
+
+        if(S_ISREG(info.st_mode)){
+            // mmap rejects empty mappings, an empty file is just an empty view
+            if(info.st_size == 0) return true;
+
+            void* addr = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(addr != MAP_FAILED){
+                mapped = static_cast<char*>(addr);
+                mappedSize = static_cast<std::size_t>(info.st_size);
+                // The scanner walks the file front to back once
+                madvise(mapped, mappedSize, MADV_SEQUENTIAL);
+                return true;
+            }
+        }
+
+        return stream(fd);
+    }
+
+    std::string_view view() const {
+        if(mapped != nullptr) return std::string_view(mapped, mappedSize);
+        return streamed;
+    }
+
+private:
+    static constexpr std::size_t chunkSize = 1 << 16;
+
+    // Read until EOF, growing the buffer geometrically so large pipes don't reallocate per chunk
+    bool stream(int fd){
+        std::size_t used = 0;
+        while(true){
+            if(streamed.size() - used < chunkSize) streamed.resize(std::max(streamed.size() * 2, used + chunkSize));
+
+            ssize_t n = ::read(fd, streamed.data() + used, streamed.size() - used);
+            if(n < 0){
+                if(errno == EINTR) continue;
+                return false;
+            }
+            if(n == 0) break;
+            used += static_cast<std::size_t>(n);
+        }
+        streamed.resize(used);
+        return true;
+    }
+
+    char* mapped = nullptr;
+    std::size_t mappedSize = 0;
+    std::string streamed;
+};
@@ -1,9 +1,11 @@
 #pragma once
 
+#include<cstdint>
 #include<string>
 
 // CPP enums are defined as this LEFT_PAREN -> 0, RIGHT_PAREN -> 1 etc...
-enum TokenType {
+// Fixed to a single byte so the token buffer can store one type per byte
+enum TokenType : std::uint8_t {
   // Single-character tokens.
   LEFT_PAREN, RIGHT_PAREN, LEFT_BRACE, RIGHT_BRACE,
   COMMA, DOT, MINUS, PLUS, SEMICOLON, SLASH, STAR,
@@ -0,0 +1,62 @@
+#pragma once
+
+#include<cstddef>
+#include<string>
+#include<variant>
+#include"interner.h"
+
+/*
+A Lox value, as produced by literals and by evaluating expressions.
+    - nil      -> std::nullptr_t
+    - booleans -> bool, numbers -> double
+    - strings  -> Symbol for interned literals, std::string for strings built at runtime (concatenation)
+Unlike std::any the value is stored inline, so passing intermediate results around never allocates
+(only the text of a computed string does).
+*/
+using Value = std::variant<std::nullptr_t, bool, double, Symbol, std::string>;
+
+// Shared by the interpreter and the optimizer (which evaluates constant expressions ahead of time)
+
+// false and null are considered to be Falsey, rest all truthy
+// eg. if(1) -> true ; if(null) -> false
+inline bool isTruthy(const Value& obj){
+    if(std::holds_alternative<bool>(obj)) return std::get<bool>(obj);
+    if(std::holds_alternative<std::nullptr_t>(obj)) return false;
+
+    return true;
+}
+
+// Strings are either interned literals (Symbol) or computed at runtime (std::string)
+inline bool isString(const Value& obj){
+    return std::holds_alternative<Symbol>(obj) || std::holds_alternative<std::string>(obj);
+}
+
+inline const std::string& asString(const Value& obj){
+    if(std::holds_alternative<Symbol>(obj)) return std::get<Symbol>(obj).str();
+    return std::get<std::string>(obj);
+}
+
+inline bool isEqual(const Value& left, const Value& right){
+    if(std::holds_alternative<std::nullptr_t>(left) && std::holds_alternative<std::nullptr_t>(right)) return true;
+    if(std::holds_alternative<std::nullptr_t>(left)) return false;
+
+    // check for string : two interned strings are equal only if they are the same symbol
+    if(std::holds_alternative<Symbol>(left) && std::holds_alternative<Symbol>(right)) {
+        return std::get<Symbol>(left) == std::get<Symbol>(right);
+    }
+    if(isString(left) && isString(right)) {
+        return asString(left) == asString(right);
+    }
+
+    // check for double
+    if(std::holds_alternative<double>(left) && std::holds_alternative<double>(right)) {
+        return std::get<double>(left) == std::get<double>(right);
+    }
+
+    // check for bool
+    if(std::holds_alternative<bool>(left) && std::holds_alternative<bool>(right)) {
+        return std::get<bool>(left) == std::get<bool>(right);
+    }
+
+    return false;
+}